@@ -2,6 +2,29 @@ settings = {
 
 	graphics = {
 		antialiasing_level = 4,
+		max_frames_in_flight = 2,
+		-- Texture data streamed to the GPU per frame, whichever runs out first
+		texture_upload_budget_kb = 4096,
+		texture_upload_budget_ms = 2.0,
+		-- Textures no longer in use are kept on the GPU for the next scene until they take more than this
+		texture_budget_mb = 512,
+		-- Mesh data replayed on the render thread per frame, whichever runs out first. The rest waits for the next frame
+		command_budget_kb = 8192,
+		command_budget_ms = 4.0,
 	},
 
-}
\ No newline at end of file
+	simulation = {
+		fixed_timestep = false,
+		tick_rate = 30,
+		max_catch_up_ticks = 5,
+	},
+
+	-- Per engine thread names, priorities (low, normal, high, critical) and core pinning. Leave cores empty to let the OS
+	-- schedule the thread anywhere. Workers get their index added to the name and are each pinned to one of their cores in turn
+	threads = {
+		main = { name = "DS Main", priority = "normal", cores = {} },
+		render = { name = "DS Render", priority = "high", cores = {} },
+		workers = { name = "DS Worker", priority = "normal", cores = {} },
+	},
+
+}
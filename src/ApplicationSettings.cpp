@@ -21,6 +21,10 @@ ApplicationSettings::ApplicationSettings(string settingsFile) {
 	opengl_minorVersion = 3;
 	opengl_vsync = false;
 
+	for (int i = 0; i < (int)threads::ThreadRole::COUNT; i++) {
+		threads_settings[i] = threads::getDefaultSettings((threads::ThreadRole)i);
+	}
+
 	if (!engine.isValid()) {
 		dout.error("Application settings LuaEngine is invalid??");
 	}
@@ -56,6 +60,80 @@ void ApplicationSettings::loadSettings(string settings) {
 					dout.log("Settings --> graphics.antialiasing_level = '" + std::to_string(antiAlias) + "'");
 				}
 			}
+			if (graphicsTable["max_frames_in_flight"].isNumber()) {
+				int framesInFlight = (int)graphicsTable["max_frames_in_flight"];
+				if (framesInFlight >= 1 && framesInFlight <= 4) {
+					opengl_maxFramesInFlight = framesInFlight;
+					dout.log("Settings --> graphics.max_frames_in_flight = '" + std::to_string(framesInFlight) + "'");
+				}
+			}
+			if (graphicsTable["texture_upload_budget_kb"].isNumber()) {
+				int budgetKB = (int)graphicsTable["texture_upload_budget_kb"];
+				if (budgetKB >= 64) {
+					opengl_textureUploadBudgetKB = budgetKB;
+					dout.log("Settings --> graphics.texture_upload_budget_kb = '" + std::to_string(budgetKB) + "'");
+				}
+			}
+			if (graphicsTable["texture_upload_budget_ms"].isNumber()) {
+				float budgetMs = (float)graphicsTable["texture_upload_budget_ms"];
+				if (budgetMs > 0.0f) {
+					opengl_textureUploadBudgetMs = budgetMs;
+					dout.log("Settings --> graphics.texture_upload_budget_ms = '" + std::to_string(budgetMs) + "'");
+				}
+			}
+			if (graphicsTable["texture_budget_mb"].isNumber()) {
+				int budgetMB = (int)graphicsTable["texture_budget_mb"];
+				if (budgetMB >= 16) {
+					opengl_textureBudgetMB = budgetMB;
+					dout.log("Settings --> graphics.texture_budget_mb = '" + std::to_string(budgetMB) + "'");
+				}
+			}
+			if (graphicsTable["command_budget_kb"].isNumber()) {
+				int budgetKB = (int)graphicsTable["command_budget_kb"];
+				if (budgetKB >= 64) {
+					opengl_commandBudgetKB = budgetKB;
+					dout.log("Settings --> graphics.command_budget_kb = '" + std::to_string(budgetKB) + "'");
+				}
+			}
+			if (graphicsTable["command_budget_ms"].isNumber()) {
+				float budgetMs = (float)graphicsTable["command_budget_ms"];
+				if (budgetMs > 0.0f) {
+					opengl_commandBudgetMs = budgetMs;
+					dout.log("Settings --> graphics.command_budget_ms = '" + std::to_string(budgetMs) + "'");
+				}
+			}
+		}
+
+		LuaRef simulationTable = settingsTable["simulation"];
+		if (simulationTable.isTable()) {
+			// We have simulation settings
+
+			if (simulationTable["fixed_timestep"].isBool()) {
+				simulation_fixedTimestep = (bool)simulationTable["fixed_timestep"];
+				dout.log("Settings --> simulation.fixed_timestep = '" + BoolToString(simulation_fixedTimestep) + "'");
+			}
+			if (simulationTable["tick_rate"].isNumber()) {
+				int tickRate = (int)simulationTable["tick_rate"];
+				if (tickRate > 0 && tickRate <= 1000) {
+					simulation_tickRate = tickRate;
+					dout.log("Settings --> simulation.tick_rate = '" + std::to_string(tickRate) + "'");
+				}
+			}
+			if (simulationTable["max_catch_up_ticks"].isNumber()) {
+				int maxCatchUp = (int)simulationTable["max_catch_up_ticks"];
+				if (maxCatchUp > 0) {
+					simulation_maxCatchUpTicks = maxCatchUp;
+					dout.log("Settings --> simulation.max_catch_up_ticks = '" + std::to_string(maxCatchUp) + "'");
+				}
+			}
+		}
+
+		LuaRef threadsTable = settingsTable["threads"];
+		if (threadsTable.isTable()) {
+			// We have thread settings
+			for (int i = 0; i < (int)threads::ThreadRole::COUNT; i++) {
+				loadThreadSettings(threadsTable, (threads::ThreadRole)i);
+			}
 		}
 
 	}
@@ -65,4 +143,45 @@ void ApplicationSettings::loadSettings(string settings) {
 	}
 
 	dout.log("Settings --> Loaded!");
-}
\ No newline at end of file
+}
+
+void ApplicationSettings::loadThreadSettings(LuaRef threadsTable, threads::ThreadRole role) {
+	string roleName = threads::roleToString(role);
+	LuaRef roleTable = threadsTable[roleName.c_str()];
+	if (!roleTable.isTable())
+		return;
+
+	threads::ThreadSettings& settings = threads_settings[(int)role];
+
+	if (roleTable["name"].isString()) {
+		settings.name = roleTable["name"].tostring();
+		dout.log("Settings --> threads." + roleName + ".name = '" + settings.name + "'");
+	}
+	if (roleTable["priority"].isString()) {
+		string priority = roleTable["priority"].tostring();
+		if (threads::priorityFromString(priority, settings.priority)) {
+			dout.log("Settings --> threads." + roleName + ".priority = '" + priority + "'");
+		}
+		else {
+			dout.warn("Settings --> threads." + roleName + ".priority '" + priority + "' should be one of low, normal, high or critical");
+		}
+	}
+	LuaRef coresTable = roleTable["cores"];
+	if (coresTable.isTable()) {
+		int numCores = (int)std::thread::hardware_concurrency();
+		settings.cores.clear();
+		string list = "";
+		for (int i = 1; i <= coresTable.length(); i++) {
+			if (!coresTable[i].isNumber())
+				continue;
+			int core = (int)coresTable[i];
+			if (core < 0 || (numCores > 0 && core >= numCores) || core >= 64) {
+				dout.warn("Settings --> threads." + roleName + ".cores has core " + std::to_string(core) + " which doesn't exist, ignoring it");
+				continue;
+			}
+			settings.cores.push_back(core);
+			list += (list.empty() ? "" : ",") + std::to_string(core);
+		}
+		dout.log("Settings --> threads." + roleName + ".cores = '{" + list + "}'");
+	}
+}
@@ -11,6 +11,7 @@ Thread safed
 */
 
 #include "LuaEngine.hpp"
+#include "ThreadConfig.hpp"
 #include <atomic>
 
 using string = std::string;
@@ -52,6 +53,37 @@ namespace darksun {
 		void set_opengl_framerateLimit(int v) {
 			opengl_framerateLimit = v;
 		}
+		int get_opengl_maxFramesInFlight() {
+			return opengl_maxFramesInFlight.load();
+		}
+		int get_opengl_textureUploadBudgetKB() {
+			return opengl_textureUploadBudgetKB.load();
+		}
+		float get_opengl_textureUploadBudgetMs() {
+			return opengl_textureUploadBudgetMs.load();
+		}
+		int get_opengl_textureBudgetMB() {
+			return opengl_textureBudgetMB.load();
+		}
+		int get_opengl_commandBudgetKB() {
+			return opengl_commandBudgetKB.load();
+		}
+		float get_opengl_commandBudgetMs() {
+			return opengl_commandBudgetMs.load();
+		}
+		bool get_simulation_fixedTimestep() {
+			return simulation_fixedTimestep.load();
+		}
+		int get_simulation_tickRate() {
+			return simulation_tickRate.load();
+		}
+		int get_simulation_maxCatchUpTicks() {
+			return simulation_maxCatchUpTicks.load();
+		}
+		// Only written while the settings are loaded
+		threads::ThreadSettings get_threads_settings(threads::ThreadRole role) {
+			return threads_settings[(int)role];
+		}
 
 	private:
 
@@ -62,10 +94,23 @@ namespace darksun {
 		std::atomic<int> opengl_minorVersion;
 		std::atomic<bool> opengl_vsync = false;
 		std::atomic<int> opengl_framerateLimit = 200;
+		std::atomic<int> opengl_maxFramesInFlight = 2;
+		std::atomic<int> opengl_textureUploadBudgetKB = 4096;
+		std::atomic<float> opengl_textureUploadBudgetMs = 2.0f;
+		std::atomic<int> opengl_textureBudgetMB = 512;
+		std::atomic<int> opengl_commandBudgetKB = 8192;
+		std::atomic<float> opengl_commandBudgetMs = 4.0f;
+		std::atomic<bool> simulation_fixedTimestep = false;
+		std::atomic<int> simulation_tickRate = 30;
+		std::atomic<int> simulation_maxCatchUpTicks = 5;
+		threads::ThreadSettings threads_settings[(int)threads::ThreadRole::COUNT];
 
 		LuaEngine engine;
 
 		void loadSettings(string file);
+
+		// Reads the settings of one thread role from its table in 'threads'
+		void loadThreadSettings(LuaRef threadsTable, threads::ThreadRole role);
 	};
 
 }
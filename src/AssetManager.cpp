@@ -0,0 +1,307 @@
+/**
+
+File: AssetManager.cpp
+Description:
+
+Central asset pipeline, stages assets across the job system and the main thread
+
+THREADING IN OPERATION, thread safe
+
+*/
+
+#include "AssetManager.hpp"
+
+using namespace darksun;
+
+// Guards the registry, the upload queue and the scheduling fields of every asset
+static std::mutex assets_mutex = std::mutex();
+
+// Every asset still alive by key, so requests for the same thing share it
+static std::map<string, std::weak_ptr<assets::Asset>> registry = std::map<string, std::weak_ptr<assets::Asset>>();
+
+// Assets waiting for their upload stage
+static std::deque<assets::AssetHandle> uploadQueue = std::deque<assets::AssetHandle>();
+
+static std::atomic<int> numLoading = 0;
+
+static void runStage(assets::AssetHandle asset);
+
+static bool hasStage(const assets::Loader& loader, assets::Stage stage) {
+	switch (stage) {
+	case assets::Stage::Read: return loader.readFile;
+	case assets::Stage::Decode: return (bool)loader.decode;
+	case assets::Stage::Process: return (bool)loader.process;
+	case assets::Stage::Upload: return (bool)loader.upload;
+	default: return true;
+	}
+}
+
+static jobs::JobPriority toJobPriority(assets::Priority priority) {
+	return (priority == assets::Priority::Visible) ? jobs::JobPriority::Normal : jobs::JobPriority::Low;
+}
+
+// Call with assets_mutex held
+static void finish(assets::AssetHandle asset, assets::State state) {
+	asset->stage = assets::Stage::Done;
+	asset->job = NULL;
+	asset->bytes.clear();
+	asset->bytes.shrink_to_fit();
+	if (state != assets::State::Ready) {
+		asset->data = NULL;
+		// Let the next request try again
+		auto it = registry.find(asset->key);
+		if (it != registry.end() && it->second.lock() == asset)
+			registry.erase(it);
+	}
+	asset->state = state;
+	numLoading--;
+	if (state == assets::State::Failed && asset->loader.failed)
+		asset->loader.failed(*asset);
+}
+
+// Moves the asset on to its next stage, skipping any the loader doesn't have. Call with assets_mutex held. Returns the job for
+// the stage, which has to be submitted once the lock is released as it may run straight away
+static jobs::JobHandle scheduleStage(assets::AssetHandle asset) {
+	while (asset->stage != assets::Stage::Done && !hasStage(asset->loader, asset->stage)) {
+		asset->stage = (assets::Stage)((int)asset->stage + 1);
+	}
+
+	if (asset->stage == assets::Stage::Done) {
+		finish(asset, assets::State::Ready);
+	}
+	else if (asset->stage == assets::Stage::Upload) {
+		asset->job = NULL;
+		asset->queuedForUpload = true;
+		uploadQueue.push_back(asset);
+	}
+	else {
+		asset->job = jobs::createJob(asset->loader.type + "::" + assets::stageToString(asset->stage),
+			[asset]() { runStage(asset); }, toJobPriority(asset->priority));
+		return asset->job;
+	}
+	return NULL;
+}
+
+static bool readFile(assets::Asset& asset) {
+	std::ifstream file(asset.path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		dout.error("AssetManager --> Could not open '" + asset.path + "'");
+		return false;
+	}
+	std::streamsize size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	asset.bytes.resize((size_t)size);
+	if (size > 0 && !file.read(asset.bytes.data(), size)) {
+		dout.error("AssetManager --> Could not read '" + asset.path + "'");
+		return false;
+	}
+	return true;
+}
+
+static void runStage(assets::AssetHandle asset) {
+	assets::Stage stage;
+	{
+		std::lock_guard lock(assets_mutex);
+		if (asset->cancelled) {
+			finish(asset, assets::State::Cancelled);
+			return;
+		}
+		stage = asset->stage;
+	}
+
+	bool ok = false;
+	try {
+		switch (stage) {
+		case assets::Stage::Read: ok = readFile(*asset); break;
+		case assets::Stage::Decode: ok = asset->loader.decode(*asset); break;
+		case assets::Stage::Process: ok = asset->loader.process(*asset); break;
+		default: break;
+		}
+	}
+	catch (...) {
+		ok = false;
+	}
+
+	jobs::JobHandle next = NULL;
+	{
+		std::lock_guard lock(assets_mutex);
+		if (!ok) {
+			dout.error("AssetManager --> " + asset->loader.type + " '" + asset->path + "' failed to " + assets::stageToString(stage));
+			finish(asset, assets::State::Failed);
+			return;
+		}
+		if (stage == assets::Stage::Decode) {
+			// Nothing after decode looks at the file any more
+			asset->bytes.clear();
+			asset->bytes.shrink_to_fit();
+		}
+		if (asset->cancelled) {
+			finish(asset, assets::State::Cancelled);
+			return;
+		}
+		asset->stage = (assets::Stage)((int)stage + 1);
+		next = scheduleStage(asset);
+	}
+	if (next != NULL)
+		jobs::submit(next);
+}
+
+/**
+
+Public interface
+
+*/
+
+assets::AssetHandle assets::load(Loader loader, string path, Priority priority, bool dedup) {
+	std::unique_lock lock(assets_mutex);
+
+	string key = loader.type + ":" + path;
+	if (dedup) {
+		auto it = registry.find(key);
+		if (it != registry.end()) {
+			AssetHandle existing = it->second.lock();
+			if (existing != NULL && !existing->cancelled) {
+				existing->users++;
+				if ((int)priority < (int)existing->priority) {
+					existing->priority = priority;
+					jobs::JobHandle queued = existing->job;
+					lock.unlock();
+					jobs::promote(queued);
+				}
+				return existing;
+			}
+		}
+
+		// Forget about anything that has been let go of
+		for (auto i = registry.begin(); i != registry.end();) {
+			if (i->second.expired())
+				i = registry.erase(i);
+			else
+				i++;
+		}
+	}
+
+	AssetHandle asset = std::make_shared<Asset>();
+	asset->key = key;
+	asset->path = path;
+	asset->loader = loader;
+	asset->priority = priority;
+	asset->users = 1;
+	if (dedup)
+		registry[key] = asset;
+	numLoading++;
+
+	jobs::JobHandle first = scheduleStage(asset);
+	lock.unlock();
+	if (first != NULL)
+		jobs::submit(first);
+	return asset;
+}
+
+void assets::setPriority(AssetHandle asset, Priority priority) {
+	if (asset == NULL)
+		return;
+	jobs::JobHandle queued = NULL;
+	{
+		std::lock_guard lock(assets_mutex);
+		if ((int)priority < (int)asset->priority)
+			queued = asset->job;
+		asset->priority = priority;
+	}
+	// The stage already queued at prefetch priority would otherwise wait behind everything else. Later stages pick the new
+	// priority up when they are scheduled
+	if (queued != NULL && priority == Priority::Visible)
+		jobs::promote(queued);
+}
+
+void assets::cancel(AssetHandle asset) {
+	if (asset == NULL)
+		return;
+	std::lock_guard lock(assets_mutex);
+	if (asset->isFinished() || --asset->users > 0)
+		return;
+
+	asset->cancelled = true;
+	if (asset->queuedForUpload) {
+		// Not on a worker, so there is nothing to stop. update() skips it
+		finish(asset, State::Cancelled);
+	}
+	// Otherwise the running stage finishes and the next one never starts
+}
+
+void assets::wait(AssetHandle asset) {
+	if (asset == NULL)
+		return;
+	while (true) {
+		jobs::JobHandle job;
+		{
+			std::lock_guard lock(assets_mutex);
+			if (asset->isFinished() || asset->job == NULL)
+				return;
+			job = asset->job;
+		}
+		// The next stage is scheduled before this job counts as finished, so we pick it up on the next loop
+		jobs::wait(job);
+	}
+}
+
+void assets::update() {
+	profiler::ScopeProfiler updateProfiler("AssetManager.cpp::assets::update()");
+
+	std::deque<AssetHandle> toUpload;
+	{
+		std::lock_guard lock(assets_mutex);
+		toUpload.swap(uploadQueue);
+		for (auto& a : toUpload) {
+			a->queuedForUpload = false;
+		}
+		// Visible assets first. Priority can be changed from any thread, so it is only read under the lock
+		std::stable_partition(toUpload.begin(), toUpload.end(), [](const AssetHandle& a) { return a->priority == Priority::Visible; });
+	}
+	if (toUpload.empty())
+		return;
+
+	for (auto& asset : toUpload) {
+		if (asset->isFinished())
+			continue; // Cancelled while queued
+
+		bool ok = false;
+		{
+			profiler::ScopeProfiler uploadProfiler("AssetManager.cpp::" + asset->loader.type + "::upload");
+			try {
+				ok = asset->loader.upload(*asset);
+			}
+			catch (...) {
+				ok = false;
+			}
+		}
+
+		std::lock_guard lock(assets_mutex);
+		if (asset->isFinished())
+			continue;
+		if (!ok) {
+			dout.error("AssetManager --> " + asset->loader.type + " '" + asset->path + "' failed to upload");
+			finish(asset, State::Failed);
+		}
+		else {
+			finish(asset, State::Ready);
+		}
+	}
+
+	profiler::addCounterToCurrentFrame("AssetManager::uploads", toUpload.size());
+}
+
+int assets::getNumberLoading() {
+	return numLoading.load();
+}
+
+string assets::stageToString(Stage stage) {
+	switch (stage) {
+	case Stage::Read: return "read";
+	case Stage::Decode: return "decode";
+	case Stage::Process: return "process";
+	case Stage::Upload: return "upload";
+	case Stage::Done: return "done";
+	default: return "unknown";
+	}
+}
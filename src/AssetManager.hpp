@@ -0,0 +1,129 @@
+#pragma once
+/**
+
+File: AssetManager.hpp
+Description:
+
+Central asset pipeline. Every asset goes through the same stages:
+
+	read -> decode -> process -> upload
+
+Read, decode and process run as jobs on the job system, upload runs on the main thread in update() and hands its data to the
+OpenGL thread through the mtopengl command stream. A loader only fills in the stages it needs. Requests for the same key share
+one asset while it is alive, visible assets are scheduled ahead of prefetched ones, and assets nobody wants any more are
+cancelled at the next stage boundary.
+
+THREADING IN OPERATION, thread safe. update() is main thread ONLY
+
+*/
+
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <fstream>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+#include "JobSystem.hpp"
+
+using string = std::string;
+
+namespace darksun::assets {
+
+	enum class Priority {
+		Visible = 0,	// Needed now, something is waiting to be drawn or played
+		Prefetch		// Wanted later, only runs when the workers have nothing better to do
+	};
+
+	enum class Stage {
+		Read = 0,
+		Decode,
+		Process,
+		Upload,
+		Done
+	};
+
+	enum class State {
+		Loading = 0,
+		Ready,
+		Failed,
+		Cancelled
+	};
+
+	struct Asset;
+	typedef std::shared_ptr<Asset> AssetHandle;
+
+	// A stage returns false if the asset failed to load
+	typedef std::function<bool(Asset&)> StageFunction;
+
+	// Describes how to load one type of asset, any stage left empty is skipped
+	struct Loader {
+		string type = "";		// Shown in the log and profiler, and part of the deduplication key
+		bool readFile = true;	// Read stage, reads the whole file at path into bytes
+		StageFunction decode;	// Worker, turns bytes (or the file at path) into data
+		StageFunction process;	// Worker, CPU side work on data
+		StageFunction upload;	// Main thread, creates the GPU or device side resources from data
+		std::function<void(Asset&)> failed; // Any thread, called once if a stage fails. The asset manager's lock is held, keep it short
+	};
+
+	struct Asset {
+		string key = "";
+		string path = "";
+		Loader loader;
+
+		// Read stage output, released once decoded
+		std::vector<char> bytes;
+		// Whatever the loader produces, read with getData<T>()
+		std::shared_ptr<void> data;
+
+		std::atomic<State> state = State::Loading;
+
+		// Owned by the asset manager
+		Stage stage = Stage::Read;
+		Priority priority = Priority::Prefetch;
+		int users = 0;
+		bool cancelled = false;
+		jobs::JobHandle job = NULL; // Job running the current stage, NULL while waiting for upload
+		bool queuedForUpload = false;
+
+		bool isReady() { return state.load() == State::Ready; }
+		bool isFinished() { return state.load() != State::Loading; }
+	};
+
+	// Loads an asset, or joins the asset already loaded or in flight for type:path. With dedup off a new load is always started.
+	// Each call counts as a user of the asset until it is cancelled
+	AssetHandle load(Loader loader, string path, Priority priority, bool dedup = true);
+
+	// Raises or lowers the priority of the stages that haven't started yet. Raising it also moves a stage already queued on the
+	// workers ahead of the prefetching
+	void setPriority(AssetHandle asset, Priority priority);
+
+	// Drops one user of the asset. Once it has no users it stops at the next stage boundary
+	void cancel(AssetHandle asset);
+
+	// Waits until no stage of the asset is running or queued on the workers. A finished or cancelled asset returns straight away,
+	// otherwise this returns once it reaches the upload stage. Workers help out while they wait
+	void wait(AssetHandle asset);
+
+	// Runs the upload stage of the assets that are ready for it, visible assets first. Main thread ONLY
+	void update();
+
+	// Returns the data of the asset, NULL if it hasn't got that far
+	template<typename T>
+	std::shared_ptr<T> getData(AssetHandle asset) {
+		if (asset == NULL)
+			return NULL;
+		return std::static_pointer_cast<T>(asset->data);
+	}
+
+	// Number of assets in flight
+	int getNumberLoading();
+
+	string stageToString(Stage stage);
+
+}
@@ -13,17 +13,26 @@ using namespace darksun;
 
 // Init static vars
 AudioEngine::SoundPlayer AudioEngine::soundPlayers[MAX_SOUND_PLAYERS];
-std::map<string, AudioEngine::SoundBuf> AudioEngine::loadedBuffers = std::map<string, AudioEngine::SoundBuf>();
+std::map<string, assets::AssetHandle> AudioEngine::loadedBuffers = std::map<string, assets::AssetHandle>();
 std::map<string, SoundCategory> AudioEngine::categories = std::map<string, SoundCategory>();
 std::vector<AudioEngine::PlayRequest> AudioEngine::soundsToPlay = std::vector<AudioEngine::PlayRequest>();
+std::vector<AudioEngine::PlayRequest> AudioEngine::soundsWaitingToLoad = std::vector<AudioEngine::PlayRequest>();
 std::vector<string> AudioEngine::soundsToStop = std::vector<string>();
+std::mutex AudioEngine::requests_mutex;
+bool AudioEngine::outputEnabled = true;
 
-void AudioEngine::init() {
+void AudioEngine::init(bool enableOutput) {
+	outputEnabled = enableOutput;
 
-	sf::Listener::setGlobalVolume(50.0f);
-	sf::Listener::setPosition(0, 0, 0);
-	sf::Listener::setUpVector(0, 1, 0);
-	sf::Listener::setDirection(0, 0, 1);
+	if (outputEnabled) {
+		sf::Listener::setGlobalVolume(50.0f);
+		sf::Listener::setPosition(0, 0, 0);
+		sf::Listener::setUpVector(0, 1, 0);
+		sf::Listener::setDirection(0, 0, 1);
+	}
+	else {
+		dout.log("Audio engine output disabled");
+	}
 
 	newCategory("default");
 	setCategoryVolume("default", 50.0f);
@@ -32,6 +41,21 @@ void AudioEngine::init() {
 	dout.log("Audio engine init complete");
 }
 
+void AudioEngine::loadSound(string source, assets::Priority priority) {
+	assets::Loader loader;
+	loader.type = "sound";
+	loader.decode = [](assets::Asset& asset) {
+		std::shared_ptr<sf::SoundBuffer> buffer = std::make_shared<sf::SoundBuffer>();
+		if (!buffer->loadFromMemory(asset.bytes.data(), asset.bytes.size())) {
+			dout.error("Attempted to load sound '" + asset.path + "' but got an internal error");
+			return false;
+		}
+		asset.data = buffer;
+		return true;
+	};
+	loadedBuffers[source] = assets::load(loader, source, priority);
+}
+
 void AudioEngine::addSound(string source) {
 	// Check for duplicates
 	if (loadedBuffers.count(source) > 0) {
@@ -39,19 +63,21 @@ void AudioEngine::addSound(string source) {
 		return;
 	}
 
-	SoundBuf buf;
-	if (buf.loadBuf(source)) {
-		// Success loading
-		loadedBuffers[source] = buf;
-	}
-	else {
-		// Failed to load
-		dout.error("Failed to load sound '" + source + "'");
-	}
+	// Nothing is waiting to hear it yet
+	loadSound(source, assets::Priority::Prefetch);
 }
 
 void AudioEngine::removeSound(string ref) {
 	if (loadedBuffers.count(ref) > 0) {
+		// Stop anything still playing it before the buffer goes
+		for (int i = 0; i < MAX_SOUND_PLAYERS; i++) {
+			if (soundPlayers[i].isAttached && soundPlayers[i].attachedRef.compare(ref) == 0) {
+				soundPlayers[i].sound.stop();
+				soundPlayers[i].sound.resetBuffer();
+				soundPlayers[i].isAttached = false;
+			}
+		}
+		assets::cancel(loadedBuffers[ref]);
 		loadedBuffers.erase(ref);
 	}
 	else {
@@ -66,6 +92,7 @@ void AudioEngine::playSound(string ref, string cat, glm::vec3 pos, bool loop, in
 	request.startIndex = startIndex;
 	request.pos = pos;
 
+	std::lock_guard lock(requests_mutex);
 	// Apply settings based on the category
 	if (categories.count(cat) == 0) {
 		dout.warn("Attempted to play sound on category " + cat + " but that category isn't registered");
@@ -78,12 +105,28 @@ void AudioEngine::playSound(string ref, string cat, glm::vec3 pos, bool loop, in
 }
 
 void AudioEngine::stopSound(string ref) {
+	std::lock_guard lock(requests_mutex);
 	soundsToStop.push_back(ref);
 }
 
 void AudioEngine::tick(float deltaTime) {
+	// Take the requests so scripts can keep queueing while we work through them
+	std::vector<string> stopRequests;
+	std::vector<PlayRequest> playRequests;
+	{
+		std::lock_guard lock(requests_mutex);
+		stopRequests.swap(soundsToStop);
+		playRequests.swap(soundsToPlay);
+	}
+
+	if (!outputEnabled)
+		return;
+
 	// Stop sounds
-	for (const auto& s : soundsToStop) {
+	for (const auto& s : stopRequests) {
+		// Including any that haven't started yet because they are still loading
+		soundsWaitingToLoad.erase(std::remove_if(soundsWaitingToLoad.begin(), soundsWaitingToLoad.end(),
+			[&s](const PlayRequest& r) { return r.ref.compare(s) == 0; }), soundsWaitingToLoad.end());
 		for (int i = 0; i < MAX_SOUND_PLAYERS; i++) {
 			if (soundPlayers[i].attachedRef.compare(s) == 0) {
 				// Found our ref
@@ -92,47 +135,69 @@ void AudioEngine::tick(float deltaTime) {
 			}
 		}
 	}
-	soundsToStop.clear();
-
-	// Play sounds
-	for (const auto& s : soundsToPlay) {
-		// Check for the ref existing
-		if (loadedBuffers.count(s.ref) == 0) {
-			// Doesn't exist
-			dout.warn("Tried to play sound '" + s.ref + "' but it isn't loaded! Loading the sound");
-			//continue; // Next request
 
-			addSound(s.ref);
+	// Play sounds, starting with the ones that were waiting for their sound to load
+	std::vector<PlayRequest> waiting;
+	waiting.swap(soundsWaitingToLoad);
+	waiting.insert(waiting.end(), playRequests.begin(), playRequests.end());
+	for (const auto& s : waiting) {
+		if (!startSound(s)) {
+			soundsWaitingToLoad.push_back(s);
 		}
+	}
+}
 
-		for (int i = 0; i < MAX_SOUND_PLAYERS; i++) {
-			if (soundPlayers[i].isStopped() || !soundPlayers[i].isAttached) {
-				// We have a free player, attach and play here
-				soundPlayers[i].isAttached = true;
-				soundPlayers[i].attachedRef = s.ref;
-				soundPlayers[i].sound.setBuffer(loadedBuffers[s.ref].buffer);
-				
-				// Set any other properties
-				soundPlayers[i].sound.setLoop(s.looped);
-				soundPlayers[i].sound.setPlayingOffset(sf::milliseconds(s.startIndex));
-				soundPlayers[i].sound.setAttenuation(s.attenuation);
-				soundPlayers[i].sound.setMinDistance(100.0f);
-				soundPlayers[i].sound.setRelativeToListener(false);
-				soundPlayers[i].sound.setPosition(s.pos.x, s.pos.y, s.pos.z);
-				soundPlayers[i].sound.setVolume(s.volume);
-
-				// Set the sound going
-				soundPlayers[i].play();
-
-				dout.verbose("AudioEngine --> playing sound in bay " + std::to_string(i) + " from source '" + s.ref + "'");
-				break;
-			}
+bool AudioEngine::startSound(const PlayRequest& s) {
+	// Check for the ref existing
+	if (loadedBuffers.count(s.ref) == 0) {
+		// Doesn't exist
+		dout.warn("Tried to play sound '" + s.ref + "' but it isn't loaded! Loading the sound");
+
+		// Someone is waiting to hear this one
+		loadSound(s.ref, assets::Priority::Visible);
+	}
+
+	assets::AssetHandle asset = loadedBuffers[s.ref];
+	if (!asset->isFinished()) {
+		// Still loading, try again next tick
+		assets::setPriority(asset, assets::Priority::Visible);
+		return false;
+	}
+	std::shared_ptr<sf::SoundBuffer> buffer = assets::getData<sf::SoundBuffer>(asset);
+	if (!asset->isReady() || buffer == NULL) {
+		// Failed to load, the error has already been logged. Keep the entry so we don't retry every time it is played
+		return true;
+	}
+
+	for (int i = 0; i < MAX_SOUND_PLAYERS; i++) {
+		if (soundPlayers[i].isStopped() || !soundPlayers[i].isAttached) {
+			// We have a free player, attach and play here
+			soundPlayers[i].isAttached = true;
+			soundPlayers[i].attachedRef = s.ref;
+			soundPlayers[i].sound.setBuffer(*buffer);
+			
+			// Set any other properties
+			soundPlayers[i].sound.setLoop(s.looped);
+			soundPlayers[i].sound.setPlayingOffset(sf::milliseconds(s.startIndex));
+			soundPlayers[i].sound.setAttenuation(s.attenuation);
+			soundPlayers[i].sound.setMinDistance(100.0f);
+			soundPlayers[i].sound.setRelativeToListener(false);
+			soundPlayers[i].sound.setPosition(s.pos.x, s.pos.y, s.pos.z);
+			soundPlayers[i].sound.setVolume(s.volume);
+
+			// Set the sound going
+			soundPlayers[i].play();
+
+			dout.verbose("AudioEngine --> playing sound in bay " + std::to_string(i) + " from source '" + s.ref + "'");
+			break;
 		}
 	}
-	soundsToPlay.clear();
+	return true;
 }
 
 void AudioEngine::update(glm::vec3 listenerPos, glm::vec3 listenerUp, glm::vec3 listenerForward) {
+	if (!outputEnabled)
+		return;
 	sf::Listener::setPosition(listenerPos.x, listenerPos.y, listenerPos.z);
 	sf::Listener::setUpVector(listenerUp.x, listenerUp.y, listenerUp.z);
 	sf::Listener::setDirection(listenerForward.x, listenerForward.y, listenerForward.z);
@@ -11,10 +11,12 @@ Audio control
 
 #include <SFML/Audio.hpp>
 #include <map>
+#include <mutex>
 
 #include <glm/vec3.hpp>
 
 #include "Log.hpp"
+#include "AssetManager.hpp"
 
 #define MAX_SOUND_PLAYERS 128
 
@@ -59,23 +61,6 @@ namespace darksun {
 			}
 		};
 
-		struct SoundBuf {
-			sf::SoundBuffer buffer;
-			string ref = ""; // Reference is the file it is loaded from aka the path
-			bool isLoaded = false;
-
-			bool loadBuf(string src) {
-				ref = src;
-				isLoaded = buffer.loadFromFile(src);
-
-				if (!isLoaded) {
-					dout.error("Attempted to load sound '" + src + "' but got an internal error");
-				}
-
-				return isLoaded;
-			}
-		};
-
 		struct PlayRequest {
 			string ref;
 			bool looped;
@@ -87,16 +72,30 @@ namespace darksun {
 
 		/* Private variables */
 		static SoundPlayer soundPlayers[MAX_SOUND_PLAYERS];
-		static std::map<string, SoundBuf> loadedBuffers;
+		// Sounds by the file they are loaded from, the asset data is the sf::SoundBuffer
+		static std::map<string, assets::AssetHandle> loadedBuffers;
 
 		static std::vector<PlayRequest> soundsToPlay;
+		// Play requests for sounds that are still loading, retried every tick. Main thread ONLY
+		static std::vector<PlayRequest> soundsWaitingToLoad;
 		static std::vector<string> soundsToStop;
 
 		static std::map<string, SoundCategory> categories;
 
+		static bool outputEnabled;
+
+		// Guards the request queues and categories, sounds can be requested from entity scripts ticking on the job system
+		static std::mutex requests_mutex;
+
+		// Requests the sound through the asset manager, the file is read and decoded on the workers
+		static void loadSound(string source, assets::Priority priority);
+
+		// Starts the sound on a free player, returns false if the sound isn't loaded yet
+		static bool startSound(const PlayRequest& request);
+
 	public:
-		// Init the engine
-		static void init();
+		// Init the engine. With output disabled no device is touched, requests are accepted and thrown away on tick
+		static void init(bool enableOutput = true);
 
 		// Tick the engine
 		static void tick(float deltaTime);
@@ -104,7 +103,7 @@ namespace darksun {
 		// Update the engine
 		static void update(glm::vec3 listenerPos, glm::vec3 listenerUp, glm::vec3 listenerForward);
 
-		// Register a sound
+		// Register a sound, it loads in the background so it is ready by the time it is played
 		static void addSound(string source);
 
 		// Unregister a sound
@@ -118,6 +117,7 @@ namespace darksun {
 
 		// Add a new category
 		static void newCategory(string ref) {
+			std::lock_guard lock(requests_mutex);
 			SoundCategory cat;
 			cat.catName = ref;
 			cat.attentuationCharacteristic = 1.0f;
@@ -132,6 +132,7 @@ namespace darksun {
 				vol = 0;
 			if (vol > 100)
 				vol = 100;
+			std::lock_guard lock(requests_mutex);
 			if (categories.count(ref) == 0)
 				return;
 			categories[ref].volume = vol;
@@ -141,6 +142,7 @@ namespace darksun {
 		static void setCategoryAttenuation(string ref, float attenuation) {
 			if (attenuation < 0)
 				attenuation = 0;
+			std::lock_guard lock(requests_mutex);
 			if (categories.count(ref) == 0)
 				return;
 			categories[ref].attentuationCharacteristic = attenuation;
@@ -0,0 +1,108 @@
+/**
+
+File: CommandBuffer.cpp
+Description:
+
+A stream of GPU commands, recorded from any thread and replayed in order on the OpenGL thread
+
+THREADING IN OPERATION, thread safe
+
+*/
+
+#include "CommandBuffer.hpp"
+
+using namespace darksun;
+
+void mtopengl::CommandBuffer::recordRaw(CommandType type, CommandPriority priority, const void* payload, size_t payloadSize, const void* data, size_t dataSize, const void* moreData, size_t moreDataSize) {
+	std::lock_guard lock(recording_mutex);
+	unsigned char* out = reserveRaw(type, priority, payload, payloadSize, dataSize + moreDataSize);
+	if (dataSize > 0)
+		std::memcpy(out, data, dataSize);
+	if (moreDataSize > 0)
+		std::memcpy(out + dataSize, moreData, moreDataSize);
+}
+
+unsigned char* mtopengl::CommandBuffer::reserveRaw(CommandType type, CommandPriority priority, const void* payload, size_t payloadSize, size_t dataSize) {
+	Header header;
+	header.type = type;
+	header.payloadSize = (unsigned int)payloadSize;
+	header.dataSize = (unsigned int)dataSize;
+	header.recordedAt = std::chrono::steady_clock::now();
+
+	size_t payloadOffset = align(sizeof(Header));
+	size_t dataOffset = payloadOffset + align(payloadSize);
+	size_t recordSize = dataOffset + align(dataSize);
+
+	Queue& queue = queues[(int)priority];
+	size_t start = queue.recording.size();
+	queue.recording.resize(start + recordSize);
+
+	unsigned char* record = queue.recording.data() + start;
+	std::memcpy(record, &header, sizeof(Header));
+	std::memcpy(record + payloadOffset, payload, payloadSize);
+
+	queue.recorded++;
+	return record + dataOffset;
+}
+
+void mtopengl::CommandBuffer::swap() {
+	replayedCommands = 0;
+	replayedBytes = 0;
+
+	for (auto& queue : queues) {
+		queue.carried = queue.queued;
+
+		if (queue.replayOffset >= queue.replaying.size()) {
+			// Everything was replayed. Give back the memory from a huge replay before we reuse the arena for recording
+			if (queue.replaying.capacity() > SHRINK_ABOVE) {
+				std::vector<unsigned char>().swap(queue.replaying);
+			}
+			queue.replaying.clear();
+			queue.replayOffset = 0;
+
+			std::lock_guard lock(recording_mutex);
+			queue.recording.swap(queue.replaying);
+			queue.queued = queue.recorded;
+			queue.recorded = 0;
+		}
+		else {
+			// Some are left over, the new commands go on the end. Drop what has been replayed once it is most of the arena
+			if (queue.replayOffset > queue.replaying.size() / 2) {
+				queue.replaying.erase(queue.replaying.begin(), queue.replaying.begin() + queue.replayOffset);
+				queue.replayOffset = 0;
+			}
+
+			std::lock_guard lock(recording_mutex);
+			queue.replaying.insert(queue.replaying.end(), queue.recording.begin(), queue.recording.end());
+			queue.recording.clear();
+			queue.queued += queue.recorded;
+			queue.recorded = 0;
+		}
+	}
+}
+
+bool mtopengl::CommandBuffer::next(CommandPriority priority, Command& command) {
+	Queue& queue = queues[(int)priority];
+	if (queue.replayOffset >= queue.replaying.size())
+		return false;
+
+	const unsigned char* record = queue.replaying.data() + queue.replayOffset;
+	Header header;
+	std::memcpy(&header, record, sizeof(Header));
+
+	size_t payloadOffset = align(sizeof(Header));
+	size_t dataOffset = payloadOffset + align(header.payloadSize);
+	size_t recordSize = dataOffset + align(header.dataSize);
+
+	command.type = header.type;
+	command.recordedAt = header.recordedAt;
+	command.payload = record + payloadOffset;
+	command.data = (header.dataSize > 0) ? record + dataOffset : NULL;
+	command.dataSize = header.dataSize;
+
+	queue.replayOffset += recordSize;
+	queue.queued--;
+	replayedCommands++;
+	replayedBytes += recordSize;
+	return true;
+}
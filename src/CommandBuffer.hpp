@@ -0,0 +1,135 @@
+#pragma once
+/**
+
+File: CommandBuffer.hpp
+Description:
+
+A stream of GPU commands. Any thread can record a command, the OpenGL thread replays them in the order they were recorded.
+Commands are POD records packed one after another into a linear arena: a header, a fixed size payload and an optional block
+of raw data (vertices, filenames etc). The arena is double buffered, recording goes into one while the other is replayed,
+and both keep their memory between frames.
+
+Each priority class has arenas of its own and is replayed in order within itself, classes are replayed most important first.
+Commands the replaying thread doesn't get to before its budget runs out stay queued and are replayed ahead of anything
+recorded after them, so anything that depends on an earlier command must be recorded in the same class.
+
+Payloads never own anything. A command may never be replayed (queued at shutdown), so payloads carry ids and references into
+state the OpenGL thread looks up, never pointers to memory the replay frees.
+
+THREADING IN OPERATION, thread safe
+
+*/
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <type_traits>
+
+namespace darksun::mtopengl {
+
+	// Every kind of command the OpenGL thread knows how to replay
+	enum class CommandType : unsigned short {
+		LoadVAO,
+		UploadTexture,
+		UpdateVBO,
+		ReleaseVAO
+	};
+
+	// Most important first
+	enum class CommandPriority : unsigned char {
+		Immediate = 0,	// Cheap bookkeeping, always replayed the frame after it is recorded
+		Terrain,		// The map, nothing can be played without it
+		Visible,		// Things on screen or about to be
+		Background,		// Anything else
+		COUNT
+	};
+
+	// A recorded command, as seen when replaying. The pointers are into the arena and valid until the next swap
+	struct Command {
+		CommandType type;
+		std::chrono::steady_clock::time_point recordedAt;
+		const unsigned char* payload = NULL;
+		const unsigned char* data = NULL;
+		size_t dataSize = 0;
+
+		// Returns the payload as the struct it was recorded from
+		template<typename T>
+		const T& getPayload() const {
+			return *reinterpret_cast<const T*>(payload);
+		}
+	};
+
+	class CommandBuffer {
+
+	public:
+		// Records a command with a POD payload, followed by dataSize bytes copied from data and then moreDataSize bytes from moreData
+		template<typename T>
+		void record(CommandType type, CommandPriority priority, const T& payload, const void* data = NULL, size_t dataSize = 0, const void* moreData = NULL, size_t moreDataSize = 0) {
+			static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "Command payloads must be POD, ids and references only");
+			recordRaw(type, priority, &payload, sizeof(T), data, dataSize, moreData, moreDataSize);
+		}
+
+		// Records a command with a POD payload and dataSize bytes of data written in place by writer(unsigned char* data), so data
+		// that has to be converted anyway doesn't go through a temporary first. The writer runs with the recording lock held, it
+		// should only fill the data in
+		template<typename T, typename Writer>
+		void recordWith(CommandType type, CommandPriority priority, const T& payload, size_t dataSize, Writer writer) {
+			static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "Command payloads must be POD, ids and references only");
+			std::lock_guard lock(recording_mutex);
+			writer(reserveRaw(type, priority, &payload, sizeof(T), dataSize));
+		}
+
+		// Takes everything recorded so far for replaying, after any commands of the same class still queued from the last swap.
+		// Recording carries on into the other arenas. Replaying thread only
+		void swap();
+
+		// Moves on to the next queued command of the class, returns false when there are none left. Replaying thread only
+		bool next(CommandPriority priority, Command& command);
+
+		// The number of commands of the class queued for replaying, and how many of those were already queued before the last swap
+		int getQueuedCommandCount(CommandPriority priority) { return queues[(int)priority].queued; }
+		int getCarriedCommandCount(CommandPriority priority) { return queues[(int)priority].carried; }
+
+		// The number of commands and bytes replayed since the last swap
+		int getReplayedCommandCount() { return replayedCommands; }
+		size_t getReplayedByteCount() { return replayedBytes; }
+
+	private:
+		struct Header {
+			CommandType type;
+			unsigned int payloadSize;
+			unsigned int dataSize;
+			std::chrono::steady_clock::time_point recordedAt;
+		};
+
+		struct Queue {
+			std::vector<unsigned char> recording;
+			int recorded = 0;
+
+			std::vector<unsigned char> replaying;
+			size_t replayOffset = 0;
+			int queued = 0;
+			int carried = 0;
+		};
+
+		// Records are padded to this so the payloads stay aligned
+		const static size_t ALIGNMENT = 16;
+		// Arenas that grew past this are given back after replaying, so one huge upload doesn't pin the memory forever
+		const static size_t SHRINK_ABOVE = 64 * 1024 * 1024;
+
+		std::mutex recording_mutex;
+		Queue queues[(int)CommandPriority::COUNT];
+
+		int replayedCommands = 0;
+		size_t replayedBytes = 0;
+
+		void recordRaw(CommandType type, CommandPriority priority, const void* payload, size_t payloadSize, const void* data, size_t dataSize, const void* moreData, size_t moreDataSize);
+		// Appends a record with its header and payload filled in and returns where its data goes. Caller holds recording_mutex
+		unsigned char* reserveRaw(CommandType type, CommandPriority priority, const void* payload, size_t payloadSize, size_t dataSize);
+
+		static size_t align(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+	};
+
+}
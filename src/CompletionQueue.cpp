@@ -0,0 +1,80 @@
+/**
+
+File: CompletionQueue.cpp
+Description:
+
+Runs callbacks once the GPU has finished the commands issued before them
+
+OpenGL thread ONLY
+
+*/
+
+#include "CompletionQueue.hpp"
+
+using namespace darksun;
+
+void mtopengl::CompletionQueue::whenComplete(Callback callback) {
+	unfenced.push_back(callback);
+	pending++;
+}
+
+void mtopengl::CompletionQueue::fence() {
+	if (unfenced.empty())
+		return;
+
+	Fence fence;
+	fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (fence.sync == 0) {
+		// Nothing to wait on, so nothing is gained by holding them back
+		dout.error("CompletionQueue --> glFenceSync failed, running callbacks now");
+		glFinish();
+		std::vector<Callback> callbacks;
+		callbacks.swap(unfenced);
+		for (auto& c : callbacks) {
+			c();
+		}
+		pending -= callbacks.size();
+		return;
+	}
+	fence.callbacks.swap(unfenced);
+	fences.push_back(std::move(fence));
+}
+
+size_t mtopengl::CompletionQueue::retireOldest() {
+	Fence oldest = std::move(fences.front());
+	fences.pop_front();
+	glDeleteSync(oldest.sync);
+
+	for (auto& c : oldest.callbacks) {
+		c();
+	}
+	pending -= oldest.callbacks.size();
+	return oldest.callbacks.size();
+}
+
+size_t mtopengl::CompletionQueue::poll() {
+	size_t ran = 0;
+	while (!fences.empty()) {
+		GLenum result = glClientWaitSync(fences.front().sync, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			// Still being worked on, and so is everything after it
+			break;
+		}
+		if (result == GL_WAIT_FAILED) {
+			dout.error("CompletionQueue --> glClientWaitSync failed, running the callbacks anyway");
+		}
+		ran += retireOldest();
+	}
+	return ran;
+}
+
+void mtopengl::CompletionQueue::finish() {
+	fence();
+	while (!fences.empty()) {
+		GLenum result = glClientWaitSync(fences.front().sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1s, so a lost context can't hang us
+		if (result == GL_WAIT_FAILED || result == GL_TIMEOUT_EXPIRED) {
+			dout.error("CompletionQueue --> Waiting on a fence failed, running the callbacks anyway");
+		}
+		retireOldest();
+	}
+}
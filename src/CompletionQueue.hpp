@@ -0,0 +1,63 @@
+#pragma once
+/**
+
+File: CompletionQueue.hpp
+Description:
+
+Runs callbacks once the GPU has finished the commands issued before them. Callbacks are queued as the OpenGL thread issues
+uploads, fence() puts a fence after everything queued so far and poll() runs the callbacks of every fence the GPU has passed.
+Polling never waits, so memory the GPU may still be reading from (staging buffers, pool ranges) is recycled a frame or two
+later without a glFinish style stall.
+
+OpenGL thread ONLY
+
+*/
+
+#include <GL/glew.h>
+
+#include <SFML/OpenGL.hpp>
+
+#include <vector>
+#include <deque>
+#include <functional>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+
+namespace darksun::mtopengl {
+
+	class CompletionQueue {
+
+	public:
+		typedef std::function<void()> Callback;
+
+		// Runs the callback once the GPU has finished everything issued before the next fence()
+		void whenComplete(Callback callback);
+
+		// Fences everything issued since the last call, if any callbacks are waiting on it
+		void fence();
+
+		// Runs the callbacks of every fence the GPU has passed, oldest first, and returns how many ran. Never waits
+		size_t poll();
+
+		// Waits for every fence and runs everything still queued, fenced or not. Called before the context goes
+		void finish();
+
+		// Callbacks not yet run
+		size_t getPendingCount() { return pending; }
+
+	private:
+		struct Fence {
+			GLsync sync;
+			std::vector<Callback> callbacks;
+		};
+
+		std::vector<Callback> unfenced;
+		std::deque<Fence> fences;
+		size_t pending = 0;
+
+		// Runs and drops the oldest fence's callbacks
+		size_t retireOldest();
+	};
+
+}
@@ -16,7 +16,44 @@ DarkSun::DarkSun() {
 }
 
 void DarkSun::processArgs(int argc, char *argv[]) {
-	// Do something here?
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+
+		if (arg.compare("--headless") == 0) {
+			headless = true;
+		}
+		else if (arg.compare("--tickrate") == 0 && hasValue) {
+			headlessTickRate = std::max(std::atoi(argv[++i]), 0);
+		}
+		else if (arg.compare("--max-ticks") == 0 && hasValue) {
+			maxTicks = std::max(std::atoll(argv[++i]), 0LL);
+		}
+		else if (arg.compare("--build-texture-cache") == 0 && hasValue) {
+			textureCacheDirectories.push_back(argv[++i]);
+		}
+		else {
+			dout.warn("Unknown command line argument '" + arg + "', ignoring");
+		}
+	}
+
+	if (headless) {
+		dout.log("Running headless, " + (headlessTickRate > 0 ? std::to_string(headlessTickRate) + " ticks/s" : string("as fast as possible")) +
+			(maxTicks > 0 ? ", stopping after " + std::to_string(maxTicks) + " ticks" : string("")));
+	}
+}
+
+void DarkSun::signalStartup(std::atomic<bool>& flag) {
+	{
+		std::lock_guard lock(startup_mutex);
+		flag = true;
+	}
+	startup_cv.notify_all();
+}
+
+void DarkSun::waitForStartup(std::atomic<bool>& flag) {
+	std::unique_lock lock(startup_mutex);
+	startup_cv.wait(lock, [&] { return flag.load() || !running.load(); });
 }
 
 void DarkSun::run() {
@@ -29,9 +66,36 @@ void DarkSun::run() {
 
 	// Load settings
 	ApplicationSettings appSettings("settings.lua");
+	profiler::markStartupPhase("settings");
+
+	// Name, pin and prioritise this thread, the others pick up their settings as they start
+	for (int i = 0; i < (int)threads::ThreadRole::COUNT; i++) {
+		threads::setRoleSettings((threads::ThreadRole)i, appSettings.get_threads_settings((threads::ThreadRole)i));
+	}
+	threads::applyRole(threads::ThreadRole::Main);
+
+	// Start the job system workers
+	jobs::init();
+	profiler::markStartupPhase("job system");
+
+	if (!textureCacheDirectories.empty()) {
+		// Offline conversion only, nothing else runs
+		for (auto const& d : textureCacheDirectories) {
+			texcache::convertDirectory(d);
+		}
+		jobs::shutdown();
+		return;
+	}
+
+	if (headless) {
+		runHeadless(&appSettings);
+		jobs::shutdown();
+		return;
+	}
 
 	// Init the audio engine
 	AudioEngine::init();
+	profiler::markStartupPhase("audio init");
 
 	std::shared_ptr<Renderer> renderer = std::shared_ptr<Renderer>(new Renderer());
 	dout.verbose("Renderer pointer created");
@@ -41,9 +105,7 @@ void DarkSun::run() {
 	std::future renderingThread = std::async(std::launch::async, &DarkSun::OpenGLThread, this, renderer, &appSettings);
 	dout.log("Rendering thread created, waiting for launch...");
 
-	while (!renderThreadStarted) {
-		// Spin our wheels
-	}
+	waitForStartup(renderThreadStarted);
 	dout.log("Detected start of rendering thread");
 
 	// we use this info for recreating scenes too, nice way of passing information
@@ -55,10 +117,13 @@ void DarkSun::run() {
 	{
 		std::lock_guard lock(activeScene_mutex);
 		activeScene = std::unique_ptr<Scene>(new Scene(renderer, &appSettings, sceneInfo));
+		activeScene->activate();
 		if (!activeScene->isValid()) {
 			dout.error("SCENE IS NOT VALID!");
 		}
 	}
+	profiler::markStartupPhase("first scene");
+	signalStartup(firstSceneCreated);
 
 	dout.log("Entering the main game engine loop");
 
@@ -71,6 +136,19 @@ void DarkSun::run() {
 	/* TEST AUDIO */
 	//AudioEngine::playSound("sounds/LCday_3_mono.ogg", "default", true);
 
+	// Fixed timestep simulation
+	bool fixedTimestep = appSettings.get_simulation_fixedTimestep();
+	float tickStep = 1.0f / (float)appSettings.get_simulation_tickRate();
+	int maxCatchUpTicks = appSettings.get_simulation_maxCatchUpTicks();
+	float accumulator = 0.0f;
+	int droppedTicks = 0;
+	// Dropped ticks are reported at most once a second, with how many went since the last report
+	int droppedSinceWarning = 0;
+	sf::Clock droppedWarningClock;
+	if (fixedTimestep) {
+		dout.log("Using fixed timestep simulation at " + std::to_string(appSettings.get_simulation_tickRate()) + " ticks/s (max catch up of " + std::to_string(maxCatchUpTicks) + " ticks)");
+	}
+
 	sf::Clock clock; // starts the clock
 	sf::Time elapsedTime = clock.getElapsedTime();
 
@@ -83,7 +161,41 @@ void DarkSun::run() {
 		deltaTime_main = elapsedTime.asSeconds();
 		clock.restart();
 
-		{
+		// Finish off the assets that have loaded, their GPU resources are queued for the rendering thread
+		assets::update();
+
+		if (fixedTimestep) {
+			accumulator += deltaTime_main;
+
+			// Run as many whole ticks as we owe, up to the catch up cap
+			int ticksThisFrame = 0;
+			while (accumulator >= tickStep && ticksThisFrame < maxCatchUpTicks) {
+				renderer->storePreviousTransforms();
+				{
+					std::lock_guard lock(activeScene_mutex);
+					// tick the scene
+					activeScene->tick(tickStep);
+				}
+				renderer->markSimulationTick(tickStep);
+
+				accumulator -= tickStep;
+				ticksThisFrame++;
+			}
+
+			// If we are still behind after the cap, drop the backlog rather than spiralling
+			if (accumulator >= tickStep) {
+				int dropped = (int)(accumulator / tickStep);
+				droppedTicks += dropped;
+				droppedSinceWarning += dropped;
+				accumulator -= dropped * tickStep;
+			}
+			if (droppedSinceWarning > 0 && droppedWarningClock.getElapsedTime().asSeconds() >= 1.0f) {
+				dout.warn("Simulation fell behind, dropped " + std::to_string(droppedSinceWarning) + " ticks in the last second (" + std::to_string(droppedTicks) + " total)");
+				droppedSinceWarning = 0;
+				droppedWarningClock.restart();
+			}
+		}
+		else {
 			std::lock_guard lock(activeScene_mutex);
 			// tick the scene
 			activeScene->tick(deltaTime_main);
@@ -95,41 +207,37 @@ void DarkSun::run() {
 		{
 			std::lock_guard lock(activeScene_mutex);
 			
-			// Pass events to the scene
-			for (auto& e : mtopengl::getEvents()) {
-				activeScene->handleEvent(e);
+			// Pass events to the scene, drained in batches straight off the event queue
+			int numEvents = 0;
+			while ((numEvents = mtopengl::getEvents(eventBuffer, EVENT_BATCH_SIZE)) > 0) {
+				for (int i = 0; i < numEvents; i++) {
+					activeScene->handleEvent(eventBuffer[i]);
+				}
 			}
 
 			// Check for scene transitions
-			if (activeScene->shouldTransition()) {
-				string target = activeScene->getNewScene();
+			handleSceneTransition(renderer, &appSettings, sceneInfo);
 
-				if (target.compare("exit") == 0) {
-					// Signal an exit
-					dout.log("Scene gave order to exit with transition");
-					running = false;
-				}
-				else {
-					// Assign the new scene
-					activeScene->close(); // Close old scene
-					sceneInfo.n = target;
-					sceneInfo.id = Scene::createNewId();
-					sceneInfo.hasMap = true;
-					activeScene = std::unique_ptr<Scene>(new Scene(renderer, &appSettings, sceneInfo));
-					//activeScene->init();
-					if (!activeScene->isValid()) {
-						running = false;
-						dout.error("TRIED TO SWITCH TO NEW SCENE '" + target + "' BUT SCENE WAS INVALID");
-					}
-					//activeScene->initTest();
-				}
-			}
+			// The rendering thread reads this rather than reaching into the scene
+			cameraEnabled = activeScene->isCameraEnabled();
 		}
 
+		// Hand the rendering thread a snapshot of this frame
+		renderer->publishFrame();
+
 		tickNo++;
 
-		using namespace std::chrono_literals;
-		std::this_thread::sleep_for(4ms);
+		if (fixedTimestep) {
+			// Sleep until the next tick is due, taking off the time this loop has already spent
+			float untilNextTick = tickStep - accumulator - clock.getElapsedTime().asSeconds();
+			if (untilNextTick > 0.0f) {
+				std::this_thread::sleep_for(std::chrono::microseconds((long long)(untilNextTick * 1000000.0f)));
+			}
+		}
+		else {
+			using namespace std::chrono_literals;
+			std::this_thread::sleep_for(4ms);
+		}
 	}
 
 	dout.log("Waiting for rendering thread to close...");
@@ -137,28 +245,192 @@ void DarkSun::run() {
 	dout.log("Rendering thread closed, return val of " + std::to_string(returnVal));
 
 	activeScene->close();
+	discardPendingScene();
+
+	jobs::shutdown();
+}
+
+void DarkSun::handleSceneTransition(std::shared_ptr<Renderer> renderer, ApplicationSettings* appSettings, SceneInformation& sceneInfo) {
+	if (transitionPending) {
+		// The current scene keeps running until the new one has been built
+		if (pendingScene.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return;
+		transitionPending = false;
+
+		std::unique_ptr<Scene> newScene = std::unique_ptr<Scene>(pendingScene.get());
+		if (newScene == NULL || !newScene->isValid()) {
+			running = false;
+			dout.error("TRIED TO SWITCH TO NEW SCENE '" + sceneInfo.n + "' BUT SCENE WAS INVALID");
+			return;
+		}
+
+		// Swap at the tick boundary
+		activeScene->close(); // Close old scene
+		newScene->activate();
+		std::shared_ptr<Scene> oldScene = std::shared_ptr<Scene>(activeScene.release());
+		activeScene = std::move(newScene);
+		dout.log("Switched to scene '" + sceneInfo.n + "' in " + std::to_string(sceneBuildClock.getElapsedTime().asMilliseconds()) + "ms");
+
+		// Tearing down the old scene (its map, UIs and Lua states) can take a while, so it's done on a worker. Its renderables were
+		// unregistered by close(), and frame packets still in flight only hold handles to their VAOs and textures with references
+		// of their own, so nothing the rendering thread reads goes with them. The UIs are kept alive by the packets that draw them
+		jobs::run("Scene::~Scene()", [oldScene]() mutable { oldScene.reset(); });
+		return;
+	}
+
+	if (!activeScene->shouldTransition())
+		return;
+
+	string target = activeScene->getNewScene();
+
+	if (target.compare("exit") == 0) {
+		// Signal an exit
+		dout.log("Scene gave order to exit with transition");
+		running = false;
+	}
+	else {
+		// Build the new scene on a worker, it is swapped in on a later tick once it is ready
+		sceneInfo.n = target;
+		sceneInfo.id = Scene::createNewId();
+		sceneInfo.hasMap = true;
+		SceneInformation info = sceneInfo;
+		dout.log("Building scene '" + target + "' in the background");
+		sceneBuildClock.restart();
+		transitionPending = true;
+		pendingScene = jobs::async<Scene*>("Scene::Scene()", [renderer, appSettings, info]() {
+			try {
+				return new Scene(renderer, appSettings, info);
+			}
+			catch (...) {
+				dout.error("Exception while building scene '" + info.n + "'");
+				return (Scene*)NULL;
+			}
+		});
+	}
+}
+
+void DarkSun::discardPendingScene() {
+	if (!transitionPending)
+		return;
+	transitionPending = false;
+
+	// It was never activated, so there is nothing registered to close
+	Scene* scene = pendingScene.get();
+	if (scene != NULL)
+		delete scene;
+}
+
+void DarkSun::runHeadless(ApplicationSettings* appSettings) {
+	// Audio requests are still accepted from scripts, they just never make a sound
+	AudioEngine::init(false);
+	profiler::markStartupPhase("audio init");
+
+	// GPU resource requests resolve straight away, nothing is uploaded
+	mtopengl::setHeadless(true);
+
+	// The renderer only holds the camera and the registered renderables, it never opens a window
+	std::shared_ptr<Renderer> renderer = std::shared_ptr<Renderer>(new Renderer());
+	renderer->createHeadless(appSettings);
+
+	SceneInformation sceneInfo;
+	sceneInfo.n = "testScene";
+	sceneInfo.id = Scene::createNewId();
+	sceneInfo.hasMap = true;
+
+	{
+		std::lock_guard lock(activeScene_mutex);
+		activeScene = std::unique_ptr<Scene>(new Scene(renderer, appSettings, sceneInfo));
+		activeScene->activate();
+		if (!activeScene->isValid()) {
+			dout.error("SCENE IS NOT VALID!");
+		}
+	}
+	profiler::markStartupPhase("first scene");
+
+	// Every tick simulates the same step, whether we are running in real time or flat out
+	int tickRate = (headlessTickRate > 0) ? headlessTickRate : appSettings->get_simulation_tickRate();
+	float tickStep = 1.0f / (float)tickRate;
+	std::chrono::steady_clock::duration tickInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / (double)tickRate));
+
+	dout.log("Entering the headless simulation loop, " + std::to_string(tickStep * 1000.0f) + "ms per tick");
+
+	long long tickNo = 0;
+	long long reportTicks = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point reportStart = start;
+	std::chrono::steady_clock::time_point nextTick = start;
+
+	while (running) {
+		profiler::newFrame();
+		profiler::ScopeProfiler myProfiler("DarkSun.cpp::DarkSun::runHeadless()");
+
+		// Finish off the assets that have loaded
+		assets::update();
+
+		{
+			std::lock_guard lock(activeScene_mutex);
+			// tick the scene
+			activeScene->tick(tickStep);
+
+			// Check for scene transitions
+			handleSceneTransition(renderer, appSettings, sceneInfo);
+		}
+
+		// Drains the requests, nothing is played
+		AudioEngine::tick(tickStep);
+
+		tickNo++;
+		reportTicks++;
+		if (maxTicks > 0 && tickNo >= maxTicks) {
+			dout.log("Reached " + std::to_string(maxTicks) + " ticks, stopping");
+			running = false;
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		float sinceReport = std::chrono::duration<float>(now - reportStart).count();
+		if (sinceReport >= 5.0f) {
+			dout.log("Headless --> " + std::to_string((float)reportTicks / sinceReport) + " ticks/s (" + std::to_string(tickNo) + " ticks total)");
+			reportTicks = 0;
+			reportStart = now;
+		}
+
+		if (headlessTickRate > 0) {
+			// Hold to the requested rate, without trying to catch up ticks we fell behind on
+			nextTick = std::max(nextTick + tickInterval, now);
+			std::this_thread::sleep_until(nextTick);
+		}
+	}
+
+	float totalSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	dout.log("Headless --> ran " + std::to_string(tickNo) + " ticks in " + std::to_string(totalSeconds) + "s, average of " +
+		std::to_string(totalSeconds > 0.0f ? (float)tickNo / totalSeconds : 0.0f) + " ticks/s");
+
+	{
+		std::lock_guard lock(activeScene_mutex);
+		activeScene->close();
+		discardPendingScene();
+	}
 }
 
 int DarkSun::OpenGLThread(std::shared_ptr<Renderer> renderer, ApplicationSettings* appSettings) {
+	threads::applyRole(threads::ThreadRole::Render);
 
 	renderer->create(appSettings);
 	dout.log("OpenGLThread() --> Rendering thread initialised");
 
 	sf::RenderWindow * window = renderer->getWindowHandle();
-	window->setVerticalSyncEnabled(appSettings->get_opengl_vsync());
-	window->setFramerateLimit(appSettings->get_opengl_framerateLimit());
+	FramePacer pacer;
+	pacer.configure(window, appSettings->get_opengl_vsync(), appSettings->get_opengl_framerateLimit(), appSettings->get_opengl_maxFramesInFlight());
+	mtopengl::setTextureUploadBudget((size_t)appSettings->get_opengl_textureUploadBudgetKB() * 1024, appSettings->get_opengl_textureUploadBudgetMs());
+	mtopengl::setTextureBudget((size_t)appSettings->get_opengl_textureBudgetMB() * 1024 * 1024);
+	mtopengl::setCommandBudget((size_t)appSettings->get_opengl_commandBudgetKB() * 1024, appSettings->get_opengl_commandBudgetMs());
 	dout.log("OpenGLThread() --> Access to window established");
 
-	renderThreadStarted = true;
+	signalStartup(renderThreadStarted);
 
 	// Wait for the active scene to be initialised
-	bool cont = false;
 	dout.log("OpenGLThread() --> Waiting for first scene to be created");
-	while (!cont) {
-		std::lock_guard lock(activeScene_mutex);
-		if (activeScene != NULL)
-			cont = true;
-	}
+	waitForStartup(firstSceneCreated);
 	dout.log("OpenGLThread() --> Detected creation of scene");
 
 	sf::Clock clock; // starts the clock
@@ -166,26 +438,18 @@ int DarkSun::OpenGLThread(std::shared_ptr<Renderer> renderer, ApplicationSetting
 
 	dout.verbose("OpenGLThread() --> Entering rendering thread loop");
 
-	bool isCamEnabled = false;
-
+	bool firstFrameMarked = false;
 	while (running) {
 		profiler::ScopeProfiler myProfiler("DarkSun.cpp::OpenGLThread()");
+
+		// Wait for this frame's deadline, input is polled straight after so it is as fresh as possible when we draw
+		pacer.beginFrame();
 		
 		// We pretend as if time isn't moving forward here, and is only at the instance we take this clock reading
 		elapsedTime = clock.getElapsedTime();
 		deltaTime_render = elapsedTime.asSeconds();
 		clock.restart();
 
-		// Process opengl requests from other threads
-		mtopengl::process();
-
-		// Draw the scene
-		renderer->render();
-
-		// Finish drawing
-		// Do the displaying
-		renderer->getWindowHandle()->display();
-
 		sf::Event event;
 		while (window->pollEvent(event)) {
 			profiler::ScopeProfiler eventPollingProfiler("DarkSun.cpp::DarkSun::OpenGLThread()eventPolling");
@@ -209,14 +473,7 @@ int DarkSun::OpenGLThread(std::shared_ptr<Renderer> renderer, ApplicationSetting
 					}
 				}
 
-				{
-					// Don't block the locking attempt on the active scene here, to prevent deadlocks
-					std::unique_lock lock(activeScene_mutex, std::try_to_lock);
-					if(lock.owns_lock())
-						isCamEnabled = activeScene->isCameraEnabled();
-				}
-
-				if (isCamEnabled) { // Only allow the camera to recieve input if the scene allows it
+				if (cameraEnabled) { // Only allow the camera to recieve input if the scene allows it
 					renderer->getCamera()->handleEvent(event, deltaTime_render);
 				}
 			}
@@ -228,22 +485,38 @@ int DarkSun::OpenGLThread(std::shared_ptr<Renderer> renderer, ApplicationSetting
 			// Pass the event to the mtopengl solution
 			mtopengl::addEvent(event);
 		}
+		// Push the last mouse move of this batch, if one is being held back for coalescing
+		mtopengl::flushEvents();
 		// Poll the keyboard checks for the mouse
-		if (hasFocus && activeScene->isCameraEnabled())
+		if (hasFocus && cameraEnabled)
 			renderer->getCamera()->pollKeyboard(deltaTime_render);
 
 		// Update the listener from the AudioEngine
 		renderer->getCamera()->updateCameraVectors();
 		AudioEngine::update(renderer->getCamera()->getPosition(), glm::vec3(0, 1, 0), renderer->getCamera()->getFrontVector());
 
-		// Update any settings we need to
-		window->setVerticalSyncEnabled(appSettings->get_opengl_vsync());
-		window->setFramerateLimit(appSettings->get_opengl_framerateLimit());
+		// Process opengl requests from other threads
+		mtopengl::process();
 
-		using namespace std::chrono_literals;
-		std::this_thread::sleep_for(2ms);
+		// Draw the scene
+		renderer->render();
+
+		// Finish drawing
+		// Do the displaying
+		renderer->getWindowHandle()->display();
+		pacer.endFrame();
+		if (!firstFrameMarked) {
+			profiler::markStartupPhase("first frame");
+			firstFrameMarked = true;
+		}
+
+		// Update any settings we need to, only applied to the window when they change
+		pacer.configure(window, appSettings->get_opengl_vsync(), appSettings->get_opengl_framerateLimit(), appSettings->get_opengl_maxFramesInFlight());
 	}
 
+	pacer.cleanup();
+	mtopengl::cleanup();
+
 	dout.log("OpenGLThread() --> Rendering thread exiting...");
 
 	return 0;
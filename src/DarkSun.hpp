@@ -13,6 +13,7 @@ Main app
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
 
 #include <chrono>
 
@@ -27,6 +28,11 @@ Main app
 
 #include "AudioEngine.hpp"
 
+#include "JobSystem.hpp"
+#include "AssetManager.hpp"
+#include "TextureCache.hpp"
+#include "FramePacer.hpp"
+
 #include <SFML/Graphics.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -42,10 +48,21 @@ namespace darksun {
 
 		int OpenGLThread(std::shared_ptr<Renderer> renderer, ApplicationSettings* appSettings);
 
+		// Startup barrier, the main thread and render thread wait on each other here rather than spinning
+		std::mutex startup_mutex;
+		std::condition_variable startup_cv;
 		std::atomic<bool> renderThreadStarted = false;
+		std::atomic<bool> firstSceneCreated = false;
+
+		// Sets a startup flag and wakes anyone waiting on the startup barrier
+		void signalStartup(std::atomic<bool>& flag);
+		// Blocks until the startup flag is set (or we stop running)
+		void waitForStartup(std::atomic<bool>& flag);
+
 		std::atomic<bool> running = false;
 		std::atomic<bool> hasFocus = false;
 		std::atomic<bool> captureMouse = false;
+		std::atomic<bool> cameraEnabled = false; // Copied from the active scene each tick for the rendering thread
 
 		std::atomic<float> deltaTime_main = 0;
 		std::atomic<float> deltaTime_render = 0;
@@ -53,6 +70,31 @@ namespace darksun {
 		std::mutex activeScene_mutex;
 		std::unique_ptr<Scene> activeScene = NULL;
 
+		// Command line options
+		bool headless = false;
+		int headlessTickRate = 0; // Real time ticks per second in headless mode, 0 ticks as fast as possible
+		long long maxTicks = 0; // Stop after this many ticks, 0 runs until told to exit
+		std::vector<string> textureCacheDirectories; // Brought up to date in the texture cache, then the engine exits
+
+		// Runs the simulation with no window, rendering or audio output
+		void runHeadless(ApplicationSettings* appSettings);
+
+		// Scene being built on a worker for a transition, swapped in once ready
+		std::future<Scene*> pendingScene;
+		bool transitionPending = false;
+		sf::Clock sceneBuildClock;
+
+		// Checks if the active scene wants to move on, starting the build of the new scene or stopping, and swaps in the new scene
+		// once it is built. Call with activeScene_mutex held
+		void handleSceneTransition(std::shared_ptr<Renderer> renderer, ApplicationSettings* appSettings, SceneInformation& sceneInfo);
+
+		// Waits for and deletes a scene still being built. Call with activeScene_mutex held
+		void discardPendingScene();
+
+		// Events are drained from mtopengl into here by the main thread
+		const static int EVENT_BATCH_SIZE = 64;
+		sf::Event eventBuffer[EVENT_BATCH_SIZE];
+
 	public:
 		/* Default constructor */
 		DarkSun();
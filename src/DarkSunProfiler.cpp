@@ -8,6 +8,7 @@ Uses black magic to monitor the functions that are being used and for how long
 */
 
 #include "DarkSunProfiler.hpp"
+#include "Log.hpp"
 
 using namespace darksun;
 
@@ -22,6 +23,15 @@ sf::Clock frameTimer;
 
 std::mutex profilingMutex;
 
+// Prefix for references added from this thread, empty for unnamed threads
+static thread_local string threadPrefix = "";
+
+// Startup timeline
+sf::Clock startupTimer;
+int lastStartupPhaseTime = 0;
+std::vector<string> startupPhases;
+std::mutex startupMutex;
+
 profiler::ScopeProfiler::ScopeProfiler(string ref) {
 #ifdef ENABLE_DS_PROFILING
 	_ref = ref;
@@ -37,8 +47,13 @@ profiler::ScopeProfiler::~ScopeProfiler() {
 #endif
 }
 
+void profiler::setThreadName(string name) {
+	threadPrefix = name.empty() ? "" : "[" + name + "] ";
+}
+
 void profiler::addToCurrentFrame(string ref, int millis) {
 #ifdef ENABLE_DS_PROFILING
+	ref = threadPrefix + ref;
 	std::lock_guard lock(profilingMutex);
 	if (currentFrame.times.count(ref) > 0) {
 		// We already have an entry, increment it
@@ -51,6 +66,14 @@ void profiler::addToCurrentFrame(string ref, int millis) {
 #endif
 }
 
+void profiler::addCounterToCurrentFrame(string ref, long long amount) {
+#ifdef ENABLE_DS_PROFILING
+	ref = threadPrefix + ref;
+	std::lock_guard lock(profilingMutex);
+	currentFrame.counters[ref] += amount;
+#endif
+}
+
 void profiler::newFrame() {
 #ifdef ENABLE_DS_PROFILING
 	std::lock_guard lock(profilingMutex);
@@ -83,6 +106,9 @@ void profiler::dumpFrame() {
 	for (auto const& time : currentFrame.times) {
 		outs << " - Ref '" << time.first << "', " << std::to_string((float)time.second / 1000.0f) << "ms" << std::endl;
 	}
+	for (auto const& counter : currentFrame.counters) {
+		outs << " - Counter '" << counter.first << "', " << std::to_string(counter.second) << std::endl;
+	}
 
 	outs.flush();
 	outs.close(); // Close the stream
@@ -100,4 +126,26 @@ void profiler::writeProfilingHeader() {
 	outs.flush();
 	outs.close();
 #endif
+}
+
+void profiler::markStartupPhase(string phase) {
+	std::lock_guard lock(startupMutex);
+	// Only the first time we reach a phase is interesting
+	if (std::find(startupPhases.begin(), startupPhases.end(), phase) != startupPhases.end()) {
+		return;
+	}
+	startupPhases.push_back(phase);
+
+	int now = startupTimer.getElapsedTime().asMicroseconds();
+	float sinceStart = (float)now / 1000.0f;
+	float sincePrevious = (float)(now - lastStartupPhaseTime) / 1000.0f;
+	lastStartupPhaseTime = now;
+
+	dout.log("Startup --> '" + phase + "' ready at " + std::to_string(sinceStart) + "ms (+" + std::to_string(sincePrevious) + "ms)");
+
+#ifdef ENABLE_DS_PROFILING
+	std::ofstream outs(output, std::ios_base::app);
+	outs << "STARTUP PHASE '" << phase << "': " << std::to_string(sinceStart) << "ms (+" << std::to_string(sincePrevious) << "ms)" << std::endl;
+	outs.close();
+#endif
 }
\ No newline at end of file
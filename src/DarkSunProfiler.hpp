@@ -17,6 +17,7 @@ Uses black magic to monitor the functions that are being used and for how long
 #include <map>
 #include <vector>
 #include <mutex>
+#include <algorithm>
 
 #include <fstream>
 #include <sstream>
@@ -52,6 +53,7 @@ namespace darksun::profiler {
 	*/
 	struct ProfileFrame {
 		std::map<string, int> times;
+		std::map<string, long long> counters;
 		int totalTime = 0;
 
 		int frameId = 0;
@@ -59,10 +61,25 @@ namespace darksun::profiler {
 
 	void addToCurrentFrame(string ref, int millis);
 
+	// Names the calling thread in the profile. References added from a named thread are prefixed with '[name] ', matching the
+	// name the OS knows the thread by
+	void setThreadName(string name);
+
+	// Adds to a named counter (command counts, bytes uploaded etc) for the current frame
+	void addCounterToCurrentFrame(string ref, long long amount);
+
 	void newFrame();
 
 	void dumpFrame();
 
 	void writeProfilingHeader();
 
+	/**
+
+	Startup timeline. Each phase is logged once with the time since the application started and the time since the previous phase,
+	so we can see where time-to-first-frame is going.
+
+	*/
+	void markStartupPhase(string phase);
+
 }
\ No newline at end of file
@@ -110,6 +110,7 @@ void Entity::init(string blueprintn, int newId) {
 			std::filesystem::path p(std::filesystem::current_path().generic_string() + "/" + ref.tostring());
 			if (std::filesystem::exists(p)) {
 				dout.verbose("Entity::init -> Model.lod_0 = '" + p.generic_string() + "'");
+				mtopengl::OwnerScope ownerScope("entity:" + bpName);
 				model = std::shared_ptr<Model>(new Model(p.generic_string())); // Close-range, high detail model
 				dout.verbose("Entity::init -> Model.lod_0 loaded");
 			}
@@ -0,0 +1,157 @@
+/**
+
+File: FramePacer.cpp
+Description:
+
+Paces the rendering thread against frame deadlines and caps the GPU frames in flight
+
+Rendering thread ONLY
+
+*/
+
+#include "FramePacer.hpp"
+
+using namespace darksun;
+
+void FramePacer::configure(sf::Window* window, bool vsync, int framerateLimit, int framesInFlight) {
+	maxFramesInFlight = std::max(framesInFlight, 1);
+
+	if ((int)vsync != appliedVsync) {
+		appliedVsync = vsync;
+		window->setVerticalSyncEnabled(vsync);
+		dout.log("FramePacer --> vsync " + string(vsync ? "enabled" : "disabled"));
+	}
+
+	if (framerateLimit != appliedFramerateLimit) {
+		appliedFramerateLimit = framerateLimit;
+		// We do the limiting ourselves, SFML would sleep after display() and add its own latency
+		window->setFramerateLimit(0);
+		if (framerateLimit > 0) {
+			frameInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / (double)framerateLimit));
+		}
+		else {
+			frameInterval = Clock::duration::zero();
+		}
+		hasDeadline = false;
+		dout.log("FramePacer --> framerate limit " + std::to_string(framerateLimit));
+	}
+}
+
+void FramePacer::waitUntil(Clock::time_point t) {
+	profiler::ScopeProfiler waitProfiler("FramePacer.cpp::FramePacer::waitUntil()");
+	Clock::time_point now = Clock::now();
+	if (t - now > SPIN_MARGIN) {
+		std::this_thread::sleep_for((t - now) - SPIN_MARGIN);
+	}
+	while (Clock::now() < t) {
+		std::this_thread::yield();
+	}
+}
+
+void FramePacer::retireFences(int maxInFlight) {
+	while (!fences.empty()) {
+		FrameFence& oldest = fences.front();
+
+		// Only block if we are over the cap, otherwise just check
+		GLuint64 timeout = ((int)fences.size() > maxInFlight) ? 100000000 : 0; // 100ms, so a lost context can't hang us
+		GLenum result = glClientWaitSync(oldest.sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+		if (result == GL_TIMEOUT_EXPIRED && timeout == 0) {
+			// Still being worked on
+			return;
+		}
+		if (result == GL_WAIT_FAILED) {
+			dout.error("FramePacer --> glClientWaitSync failed, dropping the fence");
+		}
+		else if (result != GL_TIMEOUT_EXPIRED) {
+			// The frame has been through the GPU, this is as close to presented as we can see
+			periodPresentLatency += toMillis(Clock::now() - oldest.submitted);
+			periodPresents++;
+		}
+
+		glDeleteSync(oldest.sync);
+		fences.pop_front();
+	}
+}
+
+void FramePacer::beginFrame() {
+	profiler::ScopeProfiler beginProfiler("FramePacer.cpp::FramePacer::beginFrame()");
+
+	if (frameInterval > Clock::duration::zero()) {
+		Clock::time_point now = Clock::now();
+		if (!hasDeadline) {
+			nextDeadline = now;
+			hasDeadline = true;
+		}
+		else if (now > nextDeadline + frameInterval) {
+			// We are more than a whole frame late, start again from now rather than rushing frames out to catch up
+			nextDeadline = now;
+		}
+		waitUntil(nextDeadline);
+		nextDeadline += frameInterval;
+	}
+
+	// Keep the GPU no more than maxFramesInFlight frames behind, leaving room for the one we are about to submit
+	{
+		profiler::ScopeProfiler gpuWaitProfiler("FramePacer.cpp::FramePacer::beginFrame()gpuWait");
+		retireFences(maxFramesInFlight - 1);
+	}
+
+	Clock::time_point now = Clock::now();
+	if (frameStarted) {
+		float frameTime = toMillis(now - frameStart);
+		periodFrameTime += frameTime;
+		periodMaxFrameTime = std::max(periodMaxFrameTime, frameTime);
+		periodFrames++;
+	}
+	frameStart = now;
+	frameStarted = true;
+}
+
+void FramePacer::endFrame() {
+	Clock::time_point now = Clock::now();
+
+	FrameFence fence;
+	fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	fence.submitted = now;
+	if (fence.sync != 0) {
+		fences.push_back(fence);
+	}
+
+	// Finished after the next frame should have started
+	if (hasDeadline && now > nextDeadline) {
+		periodMissed++;
+		missedDeadlines++;
+		profiler::addCounterToCurrentFrame("FramePacer::missedDeadlines", 1);
+	}
+
+	report();
+}
+
+void FramePacer::report() {
+	Clock::time_point now = Clock::now();
+	if (now - periodStart < REPORT_PERIOD) {
+		return;
+	}
+
+	averageFrameTime = (periodFrames > 0) ? (float)(periodFrameTime / periodFrames) : 0.0f;
+	averagePresentLatency = (periodPresents > 0) ? (float)(periodPresentLatency / periodPresents) : 0.0f;
+
+	dout.verbose("FramePacer --> frame time avg " + std::to_string(averageFrameTime) + "ms, max " + std::to_string(periodMaxFrameTime) +
+		"ms, present latency avg " + std::to_string(averagePresentLatency) + "ms, " + std::to_string(periodMissed) + " missed deadlines (" +
+		std::to_string(missedDeadlines) + " total)");
+
+	periodStart = now;
+	periodFrames = 0;
+	periodFrameTime = 0.0;
+	periodMaxFrameTime = 0.0f;
+	periodPresents = 0;
+	periodPresentLatency = 0.0;
+	periodMissed = 0;
+}
+
+void FramePacer::cleanup() {
+	for (auto& f : fences) {
+		glDeleteSync(f.sync);
+	}
+	fences.clear();
+}
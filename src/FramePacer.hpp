@@ -0,0 +1,105 @@
+#pragma once
+/**
+
+File: FramePacer.hpp
+Description:
+
+Paces the rendering thread. Each frame is started against a deadline (sleeping for most of the wait and spinning the last
+bit, as sleeps overshoot), and the number of frames the GPU is allowed to fall behind the CPU is capped with fences, so
+display() never ends up blocking on a deep driver queue. Keeps frame time, present latency and missed deadline statistics.
+
+Rendering thread ONLY
+
+*/
+
+#include <GL/glew.h>
+
+#include <SFML/OpenGL.hpp>
+#include <SFML/Graphics.hpp>
+
+#include <deque>
+#include <chrono>
+#include <thread>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+
+namespace darksun {
+
+	class FramePacer {
+
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		FramePacer() {}
+
+		// Applies the vsync and framerate limit to the window, only touching the window when they change
+		void configure(sf::Window* window, bool vsync, int framerateLimit, int maxFramesInFlight);
+
+		// Waits for the deadline of the next frame, and for the GPU to catch up if too many frames are in flight
+		void beginFrame();
+
+		// Call straight after display(), fences the frame and records its statistics
+		void endFrame();
+
+		// Deletes any fences still waiting
+		void cleanup();
+
+		// Statistics for the last reporting period, in milliseconds
+		float getAverageFrameTime() { return averageFrameTime; }
+		float getAveragePresentLatency() { return averagePresentLatency; }
+		unsigned long long getMissedDeadlines() { return missedDeadlines; }
+
+	private:
+		// Sleeps overshoot, so we stop sleeping this far before the deadline and spin the rest
+		const std::chrono::microseconds SPIN_MARGIN = std::chrono::microseconds(1500);
+		// How often the statistics are logged
+		const std::chrono::seconds REPORT_PERIOD = std::chrono::seconds(5);
+
+		struct FrameFence {
+			GLsync sync;
+			Clock::time_point submitted;
+		};
+
+		// Settings currently applied, -1 so the first configure() always applies
+		int appliedVsync = -1;
+		int appliedFramerateLimit = -1;
+		int maxFramesInFlight = 2;
+
+		// 0 when there is no frame rate limit, we run as fast as vsync (or the GPU) allows
+		Clock::duration frameInterval = Clock::duration::zero();
+		Clock::time_point nextDeadline;
+		bool hasDeadline = false;
+
+		Clock::time_point frameStart;
+		bool frameStarted = false;
+
+		std::deque<FrameFence> fences;
+
+		// Statistics, summed over the reporting period
+		Clock::time_point periodStart = Clock::now();
+		int periodFrames = 0;
+		double periodFrameTime = 0.0;
+		float periodMaxFrameTime = 0.0f;
+		int periodPresents = 0;
+		double periodPresentLatency = 0.0;
+		int periodMissed = 0;
+
+		float averageFrameTime = 0.0f;
+		float averagePresentLatency = 0.0f;
+		unsigned long long missedDeadlines = 0;
+
+		// Waits until the time point, sleeping then spinning
+		void waitUntil(Clock::time_point t);
+
+		// Retires every fence the GPU has passed, blocking on the oldest while there are more than maxInFlight outstanding
+		void retireFences(int maxInFlight);
+
+		// Logs and resets the statistics once per reporting period
+		void report();
+
+		static float toMillis(Clock::duration d) { return std::chrono::duration<float, std::milli>(d).count(); }
+
+	};
+
+}
@@ -0,0 +1,143 @@
+#pragma once
+/**
+
+File: FramePacket.hpp
+Description:
+
+An immutable snapshot of everything the renderer needs to draw a frame, published by the main thread after each simulation
+tick and consumed by the rendering thread. Draws are copied out of the meshes by value and the packet holds a reference to
+each VAO and texture it uses, so renderables can be changed or destroyed on any thread while a packet is still being drawn. Packets are handed over through a lock free triple buffer, so simulation of the
+next frame can overlap the drawing of the current one without either side taking scene locks.
+
+THREADING IN OPERATION, the triple buffer is thread safe for one publisher and one consumer
+
+*/
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "MultiThreadedOpenGL.hpp"
+#include "Shader.hpp"
+#include "UiHandler.hpp"
+
+namespace darksun {
+
+	// The transform of a renderable at the previous and current simulation state
+	struct FrameTransform {
+		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
+		glm::vec3 rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+
+		bool hasPrevious = false;
+		glm::vec3 previousPosition = glm::vec3(0.0f, 0.0f, 0.0f);
+		glm::vec3 previousRotation = glm::vec3(0.0f, 0.0f, 0.0f);
+		glm::vec3 previousScale = glm::vec3(1.0f, 1.0f, 1.0f);
+	};
+
+	// A texture a draw binds, and the sampler uniform it goes to
+	struct FrameTexture {
+		TextureHandle handle = 0;
+		UniformId uniform = 0;
+	};
+
+	// A single mesh to draw, with the index of the transform it uses. The index range is read from the VAO when it is drawn, as
+	// compaction of a geometry pool page can move it
+	struct FrameDrawItem {
+		mtopengl::VAOHandle vao = 0;
+		int transform = 0;
+		unsigned int firstTexture = 0; // Into the packet's textures
+		unsigned int numTextures = 0;
+	};
+
+	struct FramePacket {
+		const static int NUMBER_OF_LIGHTS = 4; // WARNING: You must update the number of lights the shader can take if you update this value!!!!!
+
+		// Incremented for every packet published
+		unsigned long long frameNumber = 0;
+
+		std::vector<FrameTransform> transforms;
+		std::vector<FrameDrawItem> drawItems;
+		std::vector<FrameTexture> textures;
+
+		// UIs to draw over the scene
+		std::vector<std::shared_ptr<UIWrangler>> uis;
+
+		// Lighting
+		glm::vec3 lightPositions[NUMBER_OF_LIGHTS];
+		glm::vec3 lightColors[NUMBER_OF_LIGHTS];
+		int lightAttenuates[NUMBER_OF_LIGHTS];
+		bool gammaCorrection = false;
+
+		// Fixed timestep interpolation, the simulation tick this packet was taken after
+		bool interpolate = false;
+		long long simulationTick = 0; // steady_clock time of the tick, in nanoseconds
+		float simulationStep = 0.0f;
+
+		// Takes a reference to every VAO and texture of the draw items, until the packet is cleared. Call once it is filled
+		void retainResources() {
+			for (auto const& item : drawItems) {
+				retainedVAOs.push_back(item.vao);
+			}
+			for (auto const& texture : textures) {
+				retainedTextures.push_back(texture.handle);
+			}
+			mtopengl::retainVAOs(retainedVAOs);
+			mtopengl::retainTextures(retainedTextures);
+		}
+
+		// Empties the packet and drops its references, keeping the allocated memory for the next one
+		void clear() {
+			mtopengl::releaseVAOs(retainedVAOs);
+			mtopengl::releaseTextures(retainedTextures);
+			retainedVAOs.clear();
+			retainedTextures.clear();
+			transforms.clear();
+			drawItems.clear();
+			textures.clear();
+			uis.clear();
+		}
+
+	private:
+		std::vector<mtopengl::VAOHandle> retainedVAOs;
+		std::vector<TextureHandle> retainedTextures;
+	};
+
+	// Hands packets from one publisher thread to one consumer thread. The publisher and consumer each own a packet, the third
+	// sits in the middle waiting to be swapped for whichever of them gets to it first
+	class FramePacketExchange {
+
+	public:
+		// Returns the packet the publisher should fill. Only call from the publishing thread
+		FramePacket* getBack() {
+			return &packets[back];
+		}
+
+		// Publishes the back packet, and takes the stale one in the middle as the new back packet
+		void publish() {
+			back = middle.exchange(back | FRESH_BIT) & INDEX_MASK;
+		}
+
+		// Returns the newest published packet, or the one we had last time if nothing new was published. Only call from the consuming thread
+		FramePacket* getFront() {
+			if (middle.load() & FRESH_BIT) {
+				front = middle.exchange(front) & INDEX_MASK;
+			}
+			return &packets[front];
+		}
+
+	private:
+		const static int FRESH_BIT = 4;
+		const static int INDEX_MASK = 3;
+
+		FramePacket packets[3];
+
+		int back = 0; // publisher only
+		std::atomic<int> middle = 1; // index of the packet in the middle, with FRESH_BIT set if it hasn't been consumed yet
+		int front = 2; // consumer only
+
+	};
+
+}
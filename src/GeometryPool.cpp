@@ -0,0 +1,237 @@
+/**
+
+File: GeometryPool.cpp
+Description:
+
+Packs mesh geometry into a few large vertex and index buffers
+
+OpenGL thread ONLY
+
+*/
+
+#include "GeometryPool.hpp"
+
+using namespace darksun;
+
+void mtopengl::GeometryPool::createBuffers(const Page& page, GLuint& VBO, GLuint& EBO) {
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)page.numVertices * getVertexSize(page.format), NULL, GL_STATIC_DRAW);
+	glGenBuffers(1, &EBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)page.numIndices * getIndexSize(page.indexType), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void mtopengl::GeometryPool::attachBuffers(Page& page) {
+	glBindVertexArray(page.VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, page.VBO);
+	mtopengl::setupVertexFormat(page.format);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.EBO);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void mtopengl::GeometryPool::createPage(VertexFormat format, GLenum indexType) {
+	Page page;
+	page.format = format;
+	page.indexType = indexType;
+	page.numVertices = getVerticesPerPage(format);
+	page.numIndices = getIndicesPerPage(indexType);
+	glGenVertexArrays(1, &page.VAO);
+	createBuffers(page, page.VBO, page.EBO);
+	attachBuffers(page);
+
+	page.freeVertices[0] = page.numVertices;
+	page.freeIndices[0] = page.numIndices;
+	page.freeVertexCount = page.numVertices;
+	page.freeIndexCount = page.numIndices;
+	pages.push_back(page);
+	mtopengl::addResource(ResourceType::GeometryPages, ResourceOwner(), getPageBytes(page));
+
+	dout.log("GeometryPool --> Created " + vertexFormatToString(format) + " page " + std::to_string(pages.size() - 1) + " (" + std::to_string(page.numVertices) +
+		" vertices, " + std::to_string(page.numIndices) + ((indexType == GL_UNSIGNED_SHORT) ? " 16" : " 32") + " bit indices)");
+}
+
+bool mtopengl::GeometryPool::takeRange(std::map<unsigned int, unsigned int>& freeList, unsigned int count, unsigned int& start) {
+	for (auto it = freeList.begin(); it != freeList.end(); it++) {
+		if (it->second < count)
+			continue;
+		start = it->first;
+		unsigned int left = it->second - count;
+		freeList.erase(it);
+		if (left > 0)
+			freeList[start + count] = left;
+		return true;
+	}
+	return false;
+}
+
+void mtopengl::GeometryPool::giveRange(std::map<unsigned int, unsigned int>& freeList, unsigned int start, unsigned int count) {
+	if (count == 0)
+		return;
+	auto next = freeList.lower_bound(start);
+	// Merge with the range before
+	if (next != freeList.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == start) {
+			start = previous->first;
+			count += previous->second;
+			freeList.erase(previous);
+		}
+	}
+	// And the one after
+	if (next != freeList.end() && start + count == next->first) {
+		count += next->second;
+		freeList.erase(next);
+	}
+	freeList[start] = count;
+}
+
+bool mtopengl::GeometryPool::allocate(uint32_t owner, VertexFormat format, GLenum indexType, unsigned int numVertices, unsigned int numIndices, GeometryAllocation& out) {
+	if (!canShare(format, indexType, numVertices, numIndices))
+		return false;
+
+	// Tries to fit it in a page as it stands
+	auto tryPage = [&](int p) {
+		Page& page = pages[p];
+		if (page.format != format || page.indexType != indexType || page.freeVertexCount < numVertices || page.freeIndexCount < numIndices)
+			return false;
+		unsigned int baseVertex, firstIndex = 0;
+		if (!takeRange(page.freeVertices, numVertices, baseVertex))
+			return false;
+		if (numIndices > 0 && !takeRange(page.freeIndices, numIndices, firstIndex)) {
+			giveRange(page.freeVertices, baseVertex, numVertices);
+			return false;
+		}
+		out.page = p;
+		out.baseVertex = baseVertex;
+		out.numVertices = numVertices;
+		out.firstIndex = firstIndex;
+		out.numIndices = numIndices;
+		page.freeVertexCount -= numVertices;
+		page.freeIndexCount -= numIndices;
+		page.live[owner] = out;
+		return true;
+	};
+
+	for (int p = 0; p < (int)pages.size(); p++) {
+		if (tryPage(p))
+			return true;
+	}
+
+	// There would be room once the free space of a page is pulled together, but copying a whole page here would be paid for by
+	// whichever command happened to need it. The page is compacted at the end of a frame instead, and this goes in a new page
+	for (int p = 0; p < (int)pages.size(); p++) {
+		if (pages[p].format == format && pages[p].indexType == indexType && pages[p].freeVertexCount >= numVertices && pages[p].freeIndexCount >= numIndices)
+			pages[p].fragmented = true;
+	}
+
+	createPage(format, indexType);
+	return tryPage((int)pages.size() - 1);
+}
+
+void mtopengl::GeometryPool::free(uint32_t owner, int pageIndex) {
+	if (pageIndex < 0 || pageIndex >= (int)pages.size())
+		return;
+	Page& page = pages[pageIndex];
+	auto it = page.live.find(owner);
+	if (it == page.live.end())
+		return;
+	GeometryAllocation allocation = it->second;
+	page.live.erase(it);
+	giveRange(page.freeVertices, allocation.baseVertex, allocation.numVertices);
+	giveRange(page.freeIndices, allocation.firstIndex, allocation.numIndices);
+	page.freeVertexCount += allocation.numVertices;
+	page.freeIndexCount += allocation.numIndices;
+}
+
+size_t mtopengl::GeometryPool::compactPending(size_t byteBudget) {
+	// The cheapest page that fits, or failing that one that has waited long enough
+	int best = -1;
+	for (int p = 0; p < (int)pages.size(); p++) {
+		Page& page = pages[p];
+		if (!page.fragmented)
+			continue;
+		page.framesWaiting++;
+		size_t bytes = getLiveBytes(page);
+		bool due = bytes <= byteBudget || page.framesWaiting >= MAX_COMPACTION_WAIT;
+		if (due && (best < 0 || bytes < getLiveBytes(pages[best])))
+			best = p;
+	}
+	if (best < 0)
+		return 0;
+
+	pages[best].fragmented = false;
+	pages[best].framesWaiting = 0;
+	return compact(best);
+}
+
+size_t mtopengl::GeometryPool::compact(int pageIndex) {
+	profiler::ScopeProfiler profiler("GeometryPool.cpp::GeometryPool::compact()");
+	Page& page = pages[pageIndex];
+
+	// Copy everything still alive to the start of new buffers on the GPU. glCopyBufferSubData can't copy between overlapping
+	// ranges of one buffer, so we move into new ones rather than shuffling down in place
+	GLuint VBO, EBO;
+	createBuffers(page, VBO, EBO);
+	size_t stride = getVertexSize(page.format);
+	size_t indexSize = getIndexSize(page.indexType);
+
+	std::vector<std::pair<uint32_t, GeometryAllocation>> live(page.live.begin(), page.live.end());
+	std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) { return a.second.baseVertex < b.second.baseVertex; });
+
+	unsigned int nextVertex = 0, nextIndex = 0;
+	for (auto& l : live) {
+		GeometryAllocation& a = l.second;
+		glBindBuffer(GL_COPY_READ_BUFFER, page.VBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)a.baseVertex * stride, (GLintptr)nextVertex * stride, (GLsizeiptr)a.numVertices * stride);
+		if (a.numIndices > 0) {
+			glBindBuffer(GL_COPY_READ_BUFFER, page.EBO);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)a.firstIndex * indexSize, (GLintptr)nextIndex * indexSize, (GLsizeiptr)a.numIndices * indexSize);
+		}
+		// Indices are relative to the base vertex, so they don't change
+		a.baseVertex = nextVertex;
+		a.firstIndex = nextIndex;
+		nextVertex += a.numVertices;
+		nextIndex += a.numIndices;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// The driver keeps the old buffers alive until the GPU is done with them
+	glDeleteBuffers(1, &page.VBO);
+	glDeleteBuffers(1, &page.EBO);
+	page.VBO = VBO;
+	page.EBO = EBO;
+	attachBuffers(page);
+
+	page.freeVertices.clear();
+	page.freeIndices.clear();
+	giveRange(page.freeVertices, nextVertex, page.numVertices - nextVertex);
+	giveRange(page.freeIndices, nextIndex, page.numIndices - nextIndex);
+
+	for (auto& l : live) {
+		page.live[l.first] = l.second;
+		if (moved)
+			moved(l.first, l.second);
+	}
+
+	size_t copied = (size_t)nextVertex * stride + (size_t)nextIndex * indexSize;
+	dout.verbose("GeometryPool --> Compacted page " + std::to_string(pageIndex) + ", " + std::to_string(live.size()) + " meshes moved");
+	profiler::addCounterToCurrentFrame("GeometryPool::compactions", 1);
+	profiler::addCounterToCurrentFrame("GeometryPool::compactedBytes", (long long)copied);
+	return copied;
+}
+
+void mtopengl::GeometryPool::cleanup() {
+	for (auto& page : pages) {
+		glDeleteVertexArrays(1, &page.VAO);
+		glDeleteBuffers(1, &page.VBO);
+		glDeleteBuffers(1, &page.EBO);
+		mtopengl::removeResource(ResourceType::GeometryPages, ResourceOwner(), getPageBytes(page));
+	}
+	pages.clear();
+}
@@ -0,0 +1,133 @@
+#pragma once
+/**
+
+File: GeometryPool.hpp
+Description:
+
+Packs mesh geometry into a few large vertex and index buffers. Each page is one VBO and one EBO sharing one VAO, meshes get a
+range of vertices and a range of indices in a page and are drawn with glDrawElementsBaseVertex, so meshes in the same page
+draw without rebinding anything. Each page holds one vertex format and one index type, so there are pages for each pair in
+use.
+
+Freed ranges go back on a free list and are merged with their neighbours. When a request doesn't fit anywhere but a page has
+enough free space in total, the request goes in a new page and the fragmented one is marked. Marked pages are compacted into new
+buffers on the GPU later, by compactPending() at the end of the frame within what is left of the command budget, and everyone
+who moved is told their new offsets.
+
+OpenGL thread ONLY
+
+*/
+
+#include <GL/glew.h>
+
+#include <SFML/OpenGL.hpp>
+
+#include <vector>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+#include "OpenGLStructs.hpp"
+#include "VertexFormats.hpp"
+#include "ResourceInventory.hpp"
+
+namespace darksun::mtopengl {
+
+	struct GeometryAllocation {
+		int page = -1;
+		unsigned int baseVertex = 0;	// In vertices
+		unsigned int numVertices = 0;
+		unsigned int firstIndex = 0;	// In indices of the page's type
+		unsigned int numIndices = 0;
+	};
+
+	class GeometryPool {
+
+	public:
+		// Called when compaction moves an allocation, with the owner given to allocate() and where it is now
+		typedef std::function<void(uint32_t owner, const GeometryAllocation& allocation)> MovedCallback;
+
+		// Sets the size of each page, pages are created as they are needed. Smaller formats and index types fit more in a page
+		GeometryPool(size_t vertexBytesPerPage, size_t indexBytesPerPage, MovedCallback moved) :
+			vertexBytesPerPage(vertexBytesPerPage), indexBytesPerPage(indexBytesPerPage), moved(moved) {}
+
+		// Finds room for the geometry in a page of its format and index type, adding a page if it has to. Never compacts, pages too
+		// fragmented to take it are marked for compactPending() instead. Returns false
+		// if it is too big to share a page, the caller should give it its own buffers. The data is not uploaded, that is up to the caller
+		bool allocate(uint32_t owner, VertexFormat format, GLenum indexType, unsigned int numVertices, unsigned int numIndices, GeometryAllocation& out);
+
+		// Returns true if geometry this size goes in a page rather than buffers of its own. Any thread, the page size never changes
+		bool canShare(VertexFormat format, GLenum indexType, unsigned int numVertices, unsigned int numIndices) const {
+			return numVertices > 0 && numVertices <= getVerticesPerPage(format) / MAX_SHARE_DIVISOR && numIndices <= getIndicesPerPage(indexType) / MAX_SHARE_DIVISOR;
+		}
+
+		unsigned int getVerticesPerPage(VertexFormat format) const { return (unsigned int)(vertexBytesPerPage / getVertexSize(format)); }
+		unsigned int getIndicesPerPage(GLenum indexType) const { return (unsigned int)(indexBytesPerPage / getIndexSize(indexType)); }
+
+		// Gives the owner's ranges in the page back
+		void free(uint32_t owner, int page);
+
+		// Compacts at most one marked page, if its live geometry fits in the byte budget or it has waited too long. Returns the
+		// number of bytes copied
+		size_t compactPending(size_t byteBudget);
+
+		GLuint getVAO(int page) { return pages[page].VAO; }
+		GLuint getVBO(int page) { return pages[page].VBO; }
+		GLuint getEBO(int page) { return pages[page].EBO; }
+		int getNumberOfPages() { return (int)pages.size(); }
+
+		// Deletes every page
+		void cleanup();
+
+	private:
+		// Anything bigger than this fraction of a page gets its own buffers, so one mesh can't hog a page
+		const static unsigned int MAX_SHARE_DIVISOR = 4;
+		// A marked page with more live geometry than the budget is compacted anyway after this many calls to compactPending(), so it
+		// isn't left fragmented forever
+		const static int MAX_COMPACTION_WAIT = 300;
+
+		struct Page {
+			VertexFormat format = VertexFormat::Full;
+			GLenum indexType = GL_UNSIGNED_INT;
+			unsigned int numVertices = 0;
+			unsigned int numIndices = 0;
+			GLuint VAO = 0;
+			GLuint VBO = 0;
+			GLuint EBO = 0;
+			// Free ranges, by start
+			std::map<unsigned int, unsigned int> freeVertices;
+			std::map<unsigned int, unsigned int> freeIndices;
+			unsigned int freeVertexCount = 0;
+			unsigned int freeIndexCount = 0;
+			// Live allocations, by owner
+			std::map<uint32_t, GeometryAllocation> live;
+			// Marked by allocate() when the free space was there but not in one piece
+			bool fragmented = false;
+			int framesWaiting = 0;
+		};
+
+		const size_t vertexBytesPerPage = 0;
+		const size_t indexBytesPerPage = 0;
+		MovedCallback moved;
+		std::vector<Page> pages;
+
+		void createPage(VertexFormat format, GLenum indexType);
+		size_t getPageBytes(const Page& page) const { return (size_t)page.numVertices * getVertexSize(page.format) + (size_t)page.numIndices * getIndexSize(page.indexType); }
+		size_t getLiveBytes(const Page& page) const {
+			return (size_t)(page.numVertices - page.freeVertexCount) * getVertexSize(page.format) + (size_t)(page.numIndices - page.freeIndexCount) * getIndexSize(page.indexType);
+		}
+		void createBuffers(const Page& page, GLuint& VBO, GLuint& EBO);
+		void attachBuffers(Page& page);
+		size_t compact(int pageIndex);
+
+		// First fit from the free list, returns false if no single range is big enough
+		static bool takeRange(std::map<unsigned int, unsigned int>& freeList, unsigned int count, unsigned int& start);
+		// Puts a range back and merges it with the ranges either side
+		static void giveRange(std::map<unsigned int, unsigned int>& freeList, unsigned int start, unsigned int count);
+	};
+
+}
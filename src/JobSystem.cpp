@@ -0,0 +1,395 @@
+/**
+
+File: JobSystem.cpp
+Description:
+
+Engine wide work-stealing job system
+
+THREADING IN OPERATION, thread safe
+
+*/
+
+#include "JobSystem.hpp"
+
+using namespace darksun;
+
+/**
+
+Worker state
+
+*/
+
+struct Worker {
+	std::mutex jobs_mutex;
+	std::deque<jobs::JobHandle> jobs;
+	std::thread thread;
+	string profilerRef;
+};
+
+static std::vector<std::unique_ptr<Worker>> workers = std::vector<std::unique_ptr<Worker>>();
+static std::atomic<bool> workersRunning = false;
+
+// Jobs submitted from threads that aren't workers land here
+static std::mutex injectionQueue_mutex = std::mutex();
+static std::deque<jobs::JobHandle> injectionQueue = std::deque<jobs::JobHandle>();
+
+// Low priority jobs from every thread, only taken once there is nothing else to do
+static std::mutex lowPriorityQueue_mutex = std::mutex();
+static std::deque<jobs::JobHandle> lowPriorityQueue = std::deque<jobs::JobHandle>();
+
+// Idle workers sleep on this until something is queued
+static std::mutex sleep_mutex = std::mutex();
+static std::condition_variable sleep_cv = std::condition_variable();
+static std::atomic<int> queuedJobs = 0;
+
+// Index of the worker the current thread is, -1 if it isn't a worker
+static thread_local int workerIndex = -1;
+
+static void enqueue(jobs::JobHandle job);
+
+static void execute(jobs::JobHandle job) {
+	{
+		profiler::ScopeProfiler jobProfiler("JobSystem.cpp::" + job->name);
+		try {
+			job->func();
+		}
+		catch (...) {
+			dout.error("JobSystem --> Job '" + job->name + "' threw an exception");
+		}
+	}
+
+	// Mark as finished and release anything that was waiting on us
+	std::vector<jobs::JobHandle> continuations;
+	{
+		std::lock_guard lock(job->continuations_mutex);
+		job->finished = true;
+		continuations.swap(job->continuations);
+	}
+	job->finished_cv.notify_all();
+	for (auto& c : continuations) {
+		if (--c->unfinishedDependencies == 0) {
+			enqueue(c);
+		}
+	}
+}
+
+// Puts a job on the normal priority queues, without counting it as queued
+static void pushNormal(jobs::JobHandle job) {
+	if (workerIndex >= 0) {
+		// Workers push onto their own deque, where they will pick it up first
+		Worker* w = workers[workerIndex].get();
+		std::lock_guard lock(w->jobs_mutex);
+		w->jobs.push_back(job);
+	}
+	else {
+		std::lock_guard lock(injectionQueue_mutex);
+		injectionQueue.push_back(job);
+	}
+}
+
+static void enqueue(jobs::JobHandle job) {
+	if (!workersRunning) {
+		// No workers to hand this to, run it here
+		execute(job);
+		return;
+	}
+
+	bool queuedLow = false;
+	if (job->priority == jobs::JobPriority::Low) {
+		// Checked again under the lock, promote() may have raised it since
+		std::lock_guard lock(lowPriorityQueue_mutex);
+		if (job->priority == jobs::JobPriority::Low) {
+			lowPriorityQueue.push_back(job);
+			queuedLow = true;
+		}
+	}
+	if (!queuedLow)
+		pushNormal(job);
+
+	{
+		std::lock_guard lock(sleep_mutex);
+		queuedJobs++;
+	}
+	sleep_cv.notify_one();
+}
+
+static jobs::JobHandle popJob() {
+	jobs::JobHandle job = NULL;
+
+	// Our own deque first, newest job as it is most likely to be warm in cache
+	if (workerIndex >= 0) {
+		Worker* w = workers[workerIndex].get();
+		std::lock_guard lock(w->jobs_mutex);
+		if (!w->jobs.empty()) {
+			job = w->jobs.back();
+			w->jobs.pop_back();
+			return job;
+		}
+	}
+
+	// Then jobs submitted from outside
+	{
+		std::lock_guard lock(injectionQueue_mutex);
+		if (!injectionQueue.empty()) {
+			job = injectionQueue.front();
+			injectionQueue.pop_front();
+			return job;
+		}
+	}
+
+	// Then steal the oldest job from someone else
+	int numWorkers = (int)workers.size();
+	int start = (workerIndex >= 0) ? workerIndex + 1 : 0;
+	for (int i = 0; i < numWorkers; i++) {
+		int victim = (start + i) % numWorkers;
+		if (victim == workerIndex)
+			continue;
+		Worker* w = workers[victim].get();
+		std::lock_guard lock(w->jobs_mutex);
+		if (!w->jobs.empty()) {
+			job = w->jobs.front();
+			w->jobs.pop_front();
+			return job;
+		}
+	}
+
+	// Finally background work, oldest first
+	{
+		std::lock_guard lock(lowPriorityQueue_mutex);
+		if (!lowPriorityQueue.empty()) {
+			job = lowPriorityQueue.front();
+			lowPriorityQueue.pop_front();
+			return job;
+		}
+	}
+
+	return job;
+}
+
+static bool tryRunOne() {
+	jobs::JobHandle job = popJob();
+	if (job == NULL)
+		return false;
+
+	queuedJobs--;
+	execute(job);
+	return true;
+}
+
+static void workerLoop(int index) {
+	workerIndex = index;
+	threads::applyRole(threads::ThreadRole::Worker, index);
+	dout.verbose("JobSystem --> Worker " + std::to_string(index) + " started");
+
+	while (workersRunning) {
+		bool ranJob = false;
+		{
+			// Time spent running jobs, so utilisation per worker shows up in the profile
+			profiler::ScopeProfiler workerProfiler(workers[index]->profilerRef);
+			ranJob = tryRunOne();
+		}
+
+		if (!ranJob) {
+			std::unique_lock lock(sleep_mutex);
+			sleep_cv.wait(lock, [] { return queuedJobs.load() > 0 || !workersRunning.load(); });
+		}
+	}
+
+	dout.verbose("JobSystem --> Worker " + std::to_string(index) + " exiting");
+}
+
+/**
+
+Public interface
+
+*/
+
+void jobs::init(int numWorkers) {
+	if (workersRunning) {
+		dout.warn("JobSystem --> init() called while already running, ignoring");
+		return;
+	}
+
+	if (numWorkers <= 0) {
+		// Leave a core each for the main and render threads
+		numWorkers = std::max((int)std::thread::hardware_concurrency() - 2, 1);
+	}
+
+	workers.clear();
+	for (int i = 0; i < numWorkers; i++) {
+		std::unique_ptr<Worker> w = std::unique_ptr<Worker>(new Worker());
+		w->profilerRef = "JobSystem.cpp::worker[" + std::to_string(i) + "]";
+		workers.push_back(std::move(w));
+	}
+
+	workersRunning = true;
+	for (int i = 0; i < numWorkers; i++) {
+		workers[i]->thread = std::thread(workerLoop, i);
+	}
+
+	dout.log("JobSystem --> Started " + std::to_string(numWorkers) + " workers");
+}
+
+void jobs::shutdown() {
+	if (!workersRunning)
+		return;
+
+	{
+		std::lock_guard lock(sleep_mutex);
+		workersRunning = false;
+	}
+	sleep_cv.notify_all();
+
+	for (auto& w : workers) {
+		if (w->thread.joinable())
+			w->thread.join();
+	}
+
+	// Finish off anything left behind
+	while (tryRunOne()) {}
+	workers.clear();
+
+	dout.log("JobSystem --> Shut down");
+}
+
+int jobs::getNumberOfWorkers() {
+	return (int)workers.size();
+}
+
+jobs::JobHandle jobs::createJob(string name, std::function<void()> func, JobPriority priority) {
+	JobHandle job = std::make_shared<Job>();
+	job->name = name;
+	job->func = func;
+	job->priority = priority;
+	return job;
+}
+
+void jobs::addDependency(JobHandle job, JobHandle dependsOn) {
+	std::lock_guard lock(dependsOn->continuations_mutex);
+	if (dependsOn->finished) {
+		// Nothing to wait for
+		return;
+	}
+	job->unfinishedDependencies++;
+	dependsOn->continuations.push_back(job);
+}
+
+void jobs::submit(JobHandle job) {
+	// Drop the submission reference, if nothing else is outstanding the job can go
+	if (--job->unfinishedDependencies == 0) {
+		enqueue(job);
+	}
+}
+
+jobs::JobHandle jobs::run(string name, std::function<void()> func, JobPriority priority) {
+	JobHandle job = createJob(name, func, priority);
+	submit(job);
+	return job;
+}
+
+void jobs::promote(JobHandle job) {
+	if (job == NULL)
+		return;
+	{
+		std::lock_guard lock(lowPriorityQueue_mutex);
+		if (job->priority == JobPriority::Normal)
+			return;
+		job->priority = JobPriority::Normal;
+		auto it = std::find(lowPriorityQueue.begin(), lowPriorityQueue.end(), job);
+		if (it == lowPriorityQueue.end())
+			return; // Not queued yet, or already taken by a worker
+		lowPriorityQueue.erase(it);
+	}
+
+	// It is still counted in queuedJobs from when it was first queued
+	pushNormal(job);
+	sleep_cv.notify_one();
+}
+
+bool jobs::isFinished(JobHandle job) {
+	return job->finished.load();
+}
+
+void jobs::wait(JobHandle job) {
+	profiler::ScopeProfiler waitProfiler("JobSystem.cpp::jobs::wait()");
+	// Workers help out while they wait. Other threads (main, render) don't, so they never pick up a long unrelated job
+	while (workerIndex >= 0 && !job->finished && tryRunOne()) {}
+
+	std::unique_lock lock(job->continuations_mutex);
+	job->finished_cv.wait(lock, [&job] { return job->finished.load(); });
+}
+
+void jobs::parallelFor(string name, int begin, int end, int grainSize, std::function<void(int, int)> func) {
+	if (end <= begin)
+		return;
+	grainSize = std::max(grainSize, 1);
+
+	int numChunks = (end - begin + grainSize - 1) / grainSize;
+	if (numChunks == 1 || !workersRunning) {
+		// Not worth splitting
+		profiler::ScopeProfiler jobProfiler("JobSystem.cpp::" + name);
+		func(begin, end);
+		return;
+	}
+
+	// Chunks are claimed from a shared counter by the helpers and by the calling thread
+	struct ForState {
+		std::atomic<int> nextChunk = 0;
+		std::mutex done_mutex;
+		std::condition_variable done_cv;
+		int chunksDone = 0;
+		std::exception_ptr error; // First exception thrown by a chunk, with done_mutex
+	};
+	std::shared_ptr<ForState> state = std::make_shared<ForState>();
+
+	auto runChunks = [state, begin, end, grainSize, numChunks, func]() {
+		int chunk;
+		while ((chunk = state->nextChunk++) < numChunks) {
+			int chunkBegin = begin + (chunk * grainSize);
+			int chunkEnd = std::min(chunkBegin + grainSize, end);
+			std::exception_ptr error;
+			try {
+				func(chunkBegin, chunkEnd);
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+			// Every chunk is counted, thrown or not, or the caller would wait forever
+			bool last;
+			{
+				std::lock_guard lock(state->done_mutex);
+				if (error && !state->error)
+					state->error = error;
+				last = (++state->chunksDone == numChunks);
+			}
+			if (last)
+				state->done_cv.notify_all();
+		}
+	};
+
+	int helpers = std::min(numChunks - 1, (int)workers.size());
+	for (int i = 0; i < helpers; i++) {
+		run(name, runChunks);
+	}
+
+	// Do our share, then wait for the chunks the helpers claimed
+	{
+		profiler::ScopeProfiler jobProfiler("JobSystem.cpp::" + name);
+		runChunks();
+	}
+	auto allDone = [&state, numChunks] {
+		std::lock_guard lock(state->done_mutex);
+		return state->chunksDone == numChunks;
+	};
+	// Every chunk has been claimed by now, workers run other jobs while the last ones finish
+	while (workerIndex >= 0 && !allDone() && tryRunOne()) {}
+
+	std::exception_ptr error;
+	{
+		std::unique_lock lock(state->done_mutex);
+		state->done_cv.wait(lock, [&state, numChunks] { return state->chunksDone == numChunks; });
+		error = state->error;
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
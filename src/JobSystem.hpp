@@ -0,0 +1,105 @@
+#pragma once
+/**
+
+File: JobSystem.hpp
+Description:
+
+Engine wide work-stealing job system. Each worker owns a deque of jobs, pops from its own end and steals from the other end of everyone
+else's. Jobs can depend on other jobs, forming task graphs, and parallelFor splits a range across the workers.
+
+THREADING IN OPERATION, thread safe
+
+*/
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <exception>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+#include "ThreadConfig.hpp"
+
+using string = std::string;
+
+namespace darksun::jobs {
+
+	// Low priority jobs only run when there is no normal priority work queued anywhere, for background work like prefetching
+	enum class JobPriority {
+		Normal = 0,
+		Low
+	};
+
+	// A unit of work. Only ever handled through a JobHandle
+	struct Job {
+		string name = "";
+		std::function<void()> func;
+		std::atomic<JobPriority> priority = JobPriority::Normal;
+
+		// Dependencies that haven't finished yet, plus one for the job not having been submitted yet
+		std::atomic<int> unfinishedDependencies = 1;
+		std::atomic<bool> finished = false;
+
+		// Jobs waiting on this one. Threads in wait() sleep on finished_cv, with continuations_mutex
+		std::mutex continuations_mutex;
+		std::vector<std::shared_ptr<Job>> continuations;
+		std::condition_variable finished_cv;
+	};
+
+	typedef std::shared_ptr<Job> JobHandle;
+
+	// Starts the worker threads. numWorkers <= 0 picks one per core, leaving room for the main and render threads
+	void init(int numWorkers = 0);
+
+	// Stops and joins the worker threads. Jobs still queued are run on the calling thread first
+	void shutdown();
+
+	// Returns the number of worker threads running
+	int getNumberOfWorkers();
+
+	// Creates a job but doesn't submit it, so dependencies can be added first
+	JobHandle createJob(string name, std::function<void()> func, JobPriority priority = JobPriority::Normal);
+
+	// Makes job wait for dependsOn to finish. Must be called before job is submitted
+	void addDependency(JobHandle job, JobHandle dependsOn);
+
+	// Submits a job, it runs once all of its dependencies are finished
+	void submit(JobHandle job);
+
+	// Creates and submits a job with no dependencies
+	JobHandle run(string name, std::function<void()> func, JobPriority priority = JobPriority::Normal);
+
+	// Raises a low priority job to normal priority. A job still waiting in the low priority queue is moved to the normal queues,
+	// one not submitted yet or still waiting on dependencies is queued as normal priority when it is. Does nothing to a job that
+	// is already running or finished
+	void promote(JobHandle job);
+
+	// Returns if the job has finished
+	bool isFinished(JobHandle job);
+
+	// Waits for a job to finish. Workers run other jobs while they wait, other threads sleep until it is done
+	void wait(JobHandle job);
+
+	// Runs func over [begin, end) in chunks of at most grainSize, split across the workers. Blocks until every chunk is done. If a
+	// chunk throws the rest still run, and the first exception is rethrown here once they are done
+	void parallelFor(string name, int begin, int end, int grainSize, std::function<void(int, int)> func);
+
+	// Runs func as a job and returns a future for the result. If job is given it is set to the job, so it can be waited on with wait()
+	template<typename R>
+	std::future<R> async(string name, std::function<R()> func, JobHandle* job = NULL) {
+		std::shared_ptr<std::packaged_task<R()>> task = std::make_shared<std::packaged_task<R()>>(func);
+		std::future<R> result = task->get_future();
+		JobHandle handle = run(name, [task]() { (*task)(); });
+		if (job != NULL)
+			*job = handle;
+		return result;
+	}
+
+}
@@ -102,9 +102,19 @@ Map::Map(string mapfolder) {
 	// Make sure we aren't marked as loaded
 	setLoaded(false);
 
-	dout.log("Spawning thread to load map....");
-	loadingThreadResult = std::async(std::launch::async, &Map::loadMap, this);
-	dout.log("Waiting for thread to finish...");
+	dout.log("Requesting map load....");
+	assets::Loader loader;
+	loader.type = "map";
+	loader.decode = decodeHeightmap;
+	loader.process = [this](assets::Asset& asset) {
+		std::shared_ptr<Heightmap> heightmap = std::static_pointer_cast<Heightmap>(asset.data);
+		std::shared_ptr<LoadingResult> loaded = std::make_shared<LoadingResult>(loadMap(*heightmap));
+		asset.data = loaded;
+		return loaded->exitValue == 0;
+	};
+	// The process stage works on this map, so it is never shared with another one
+	loadingAsset = assets::load(loader, heightMapLoc, assets::Priority::Visible, false);
+	dout.log("Waiting for the map to load...");
 
 	//dout.log("Loaded map model and texture");
 	valid = true;
@@ -140,37 +150,42 @@ void Map::tick(float deltaTime) {
 		throw new std::exception("Invalid Map");
 	}
 	
-	if (!isLoaded()) {
+	if (!meshCreated) {
 		// Check to see if the result is ready
-		if (loadingThreadResult._Is_ready()) {
+		if (loadingAsset->isFinished()) {
 			dout.log("Map loading finished, creating Map");
-			result = loadingThreadResult.get();
+			std::shared_ptr<LoadingResult> loaded = assets::getData<LoadingResult>(loadingAsset);
+			if (loadingAsset->isReady() && loaded != NULL)
+				result = *loaded;
 
 			if (result.exitValue == 0) {
 				// Create the mesh
-				dout.verbose("MESH CREATION (Map): Got " + std::to_string(result.vertexBuff.size()) + " verticies, " + 
-					std::to_string(result.indiciesBuff.size()) + " indicies");
-
-				/*
-				
-				WE ARE FORCED TO LOAD THE TEXTURE IN THE MAIN THREAD TO PREVENT ANY CRAPSTORMS WITH MULTI-THREADING OPENGL
-				
-				*/
-
-				std::vector<Texture> texts;
-				Texture diffuse; // Create a specular map from the height map
-				diffuse.id = mtopengl::getTexture(result.textInfo.diffuseSrc.c_str(), result.textInfo.diffuseGammaCorrection);
-				diffuse.type = "texture_diffuse"; // Set to the diffuse
-				diffuse.path = textureLoc.c_str();
-				texts.push_back(diffuse);
-				
-				Mesh mapMesh(result.vertexBuff, result.indiciesBuff, texts);
-				addMesh(mapMesh);
-
+				dout.verbose("MESH CREATION (Map): Got " + std::to_string(result.chunks.size()) + " chunks");
+
+				// The VAOs are created on the OpenGL thread, we count as loaded once the meshes have resolved them. The texture streams in afterwards
+				mtopengl::OwnerScope ownerScope("map");
+				mtopengl::PriorityScope priorityScope(mtopengl::CommandPriority::Terrain);
+				for (auto const& chunk : result.chunks) {
+					// Every chunk holds its own reference to the one texture
+					std::vector<Texture> texts;
+					Texture diffuse; // Create a specular map from the height map
+					diffuse.handle = mtopengl::requestTexture(result.textInfo.diffuseSrc.c_str(), result.textInfo.diffuseGammaCorrection);
+					diffuse.type = "texture_diffuse"; // Set to the diffuse
+					texts.push_back(diffuse);
+
+					// The terrain has no normal map, so it doesn't need its tangents on the GPU
+					Mesh mapMesh(chunk.vertexBuff, chunk.indiciesBuff, texts, VertexFormat::Terrain);
+					addMesh(mapMesh);
+				}
+				// Only the meshes need them now
+				result.chunks.clear();
+
+				meshCreated = true;
 				setLoaded(true);
 			}
 			else {
 				dout.error("Map loading failed!");
+				meshCreated = true;
 				valid = false;
 			}
 		}
@@ -181,24 +196,44 @@ void Map::tick(float deltaTime) {
 
 }
 
-// MULTI-THREADED FUNCTION
-Map::LoadingResult Map::loadMap() {
-	dout.log("Map loading thread launched OK");
-	
-	LoadingResult result;
-	
+// WORKER
+bool Map::decodeHeightmap(assets::Asset& asset) {
 	int width, height, channels;
 	int wantedChannels = 1; // We want only greyscale
-	dout.verbose("Map::loadMap() --> Attempting to load data from \"" + heightMapLoc + "\"");
-	unsigned char *data = stbi_load(heightMapLoc.c_str(), &width, &height, &channels, wantedChannels);
+	dout.verbose("Map::decodeHeightmap() --> Attempting to decode data from \"" + asset.path + "\"");
+	unsigned char *data = stbi_load_from_memory((const stbi_uc*)asset.bytes.data(), (int)asset.bytes.size(), &width, &height, &channels, wantedChannels);
 
 	if (data == NULL) {
 		// The load failed
 		dout.error("stbi load failure: NULL PTR. Data could not be loaded from the image file specified: " + string(stbi_failure_reason()));
-		result.exitValue = -1; // Failure exit
-		return result;
+		return false;
 	}
 
+	std::shared_ptr<Heightmap> heightmap = std::make_shared<Heightmap>();
+	heightmap->width = width;
+	heightmap->height = height;
+	heightmap->channels = channels;
+	heightmap->pixels.assign(data, data + (width * height * wantedChannels));
+
+	// Free the data buffer
+	stbi_image_free(data);
+
+	asset.data = heightmap;
+	return true;
+}
+
+// WORKER
+Map::LoadingResult Map::loadMap(const Heightmap& heightmap) {
+	dout.log("Map loading stage launched OK");
+	
+	LoadingResult result;
+	
+	int width = heightmap.width;
+	int height = heightmap.height;
+	int channels = heightmap.channels;
+	int wantedChannels = 1; // We want only greyscale
+	const unsigned char *data = heightmap.pixels.data();
+
 	loadedPercent = 10.0; // 10%
 
 	// we got the data
@@ -256,33 +291,10 @@ Map::LoadingResult Map::loadMap() {
 
 	dout.verbose("Map::loadMap() --> Got lowest point as: " + std::to_string(lowestP) + " with highest as: " + std::to_string(highestP));
 
-	// Free the data buffer
-	stbi_image_free(data);
-
 	dout.verbose("Map::loadMap() --> Created and populated vertexBuff");
 
-	// Create the indicies
-	std::vector<unsigned int> indiciesBuff;
-	for (int y = 0; y < heightmapBuffer_height - 1; y++) {
-		for (int x = 0; x < heightmapBuffer_width - 1; x++) {
-			unsigned int topL = (y*heightmapBuffer_width) + x;
-			unsigned int topR = topL + 1;
-			unsigned int botL = ((y + 1)*heightmapBuffer_width) + x;
-			unsigned int botR = botL + 1;
-
-			// Do first triangle
-			indiciesBuff.push_back(botL); indiciesBuff.push_back(topR); indiciesBuff.push_back(topL); // Correct
-			//indiciesBuff.push_back(topL); indiciesBuff.push_back(topR); indiciesBuff.push_back(botL); // Old way
-
-			// Do second triangle
-			indiciesBuff.push_back(botL); indiciesBuff.push_back(botR); indiciesBuff.push_back(topR); // Correct
-			//indiciesBuff.push_back(topR); indiciesBuff.push_back(botR); indiciesBuff.push_back(botL); // Old way
-
-			loadedPercent = loadedPercent + percentPerIteration; // Keep the user updated with a loaded percent value
-		}
-	}
-
-	dout.verbose("Map::loadMap() --> Created and populated indiciesBuff");
+	// The indicies are created per chunk once the vertices are final
+	loadedPercent = 60.0f; // 60%
 
 	glm::vec3 v4; glm::vec3 v2;
 	glm::vec3 v1; glm::vec3 v3;
@@ -311,40 +323,81 @@ Map::LoadingResult Map::loadMap() {
 		}
 	}
 
-	// Calculate the normals correctly
-	glm::vec3 v12; glm::vec3 v23;
-	glm::vec3 v34; glm::vec3 v41;
-	int normalsProcessed = 0;
-	for (int y = 0; y < heightmapBuffer_height; y++) {
-		for (int x = 0; x < heightmapBuffer_width; x++) {
-			if (x > 0 && x < heightmapBuffer_width - 1 && y > 0 && y < heightmapBuffer_height - 1) {
-				Vertex *vert = &vertexBuff.at((y*heightmapBuffer_width) + x);
-
-				v0 = vert->Position;
-				v1 = vertexBuff.at((y*heightmapBuffer_width) + x - 1).Position - v0;
-				v3 = vertexBuff.at((y*heightmapBuffer_width) + x + 1).Position - v0;
-				v2 = vertexBuff.at(((y+1)*heightmapBuffer_width) + x).Position - v0;
-				v4 = vertexBuff.at(((y-1)*heightmapBuffer_width) + x).Position - v0;
+	// Calculate the normals correctly, each row only writes its own vertices so the rows are split across the job system
+	std::atomic<int> normalsProcessed = 0;
+	std::atomic<int> rowsProcessed = 0;
+	jobs::parallelFor("Map::loadMap()normals", 0, heightmapBuffer_height, 16, [&](int rowBegin, int rowEnd) {
+		glm::vec3 v0; glm::vec3 v1; glm::vec3 v2; glm::vec3 v3; glm::vec3 v4;
+		glm::vec3 v12; glm::vec3 v23;
+		glm::vec3 v34; glm::vec3 v41;
+		int processed = 0;
+		for (int y = rowBegin; y < rowEnd; y++) {
+			for (int x = 0; x < heightmapBuffer_width; x++) {
+				if (x > 0 && x < heightmapBuffer_width - 1 && y > 0 && y < heightmapBuffer_height - 1) {
+					Vertex *vert = &vertexBuff.at((y*heightmapBuffer_width) + x);
+
+					v0 = vert->Position;
+					v1 = vertexBuff.at((y*heightmapBuffer_width) + x - 1).Position - v0;
+					v3 = vertexBuff.at((y*heightmapBuffer_width) + x + 1).Position - v0;
+					v2 = vertexBuff.at(((y+1)*heightmapBuffer_width) + x).Position - v0;
+					v4 = vertexBuff.at(((y-1)*heightmapBuffer_width) + x).Position - v0;
+
+					v12 = glm::normalize(glm::cross(v1, v2));
+					v23 = glm::normalize(glm::cross(v2, v3));
+					v34 = glm::normalize(glm::cross(v3, v4));
+					v41 = glm::normalize(glm::cross(v4, v1));
+
+					vert->Normal = glm::normalize(v12 + v23 + v34 + v41);
+					vert->Bitangent = glm::normalize(glm::cross(vert->Normal, vert->Tangent));
+
+					processed++;
+				}
+				// The normals are initialised fine already so we can just ignore if we don't meet the above conditions
+			}
+		}
+		normalsProcessed += processed;
+		rowsProcessed += (rowEnd - rowBegin);
+		loadedPercent = 60.0f + (25.0f * (float)rowsProcessed.load() / (float)heightmapBuffer_height); // Keep the user updated with a loaded percent value
+	});
 
-				v12 = glm::normalize(glm::cross(v1, v2));
-				v23 = glm::normalize(glm::cross(v2, v3));
-				v34 = glm::normalize(glm::cross(v3, v4));
-				v41 = glm::normalize(glm::cross(v4, v1));
+	dout.verbose("Map::loadMap() --> Perfected vertex normals (" + std::to_string(normalsProcessed.load()) + " processed)");
 
-				vert->Normal = glm::normalize(v12 + v23 + v34 + v41);
-				vert->Bitangent = glm::normalize(glm::cross(vert->Normal, vert->Tangent));
+	loadedPercent = 85.0f; // 85%
 
-				normalsProcessed++;
+	// Split into chunks, each with its own copy of its vertices and indicies into them
+	std::vector<TerrainChunk> chunks;
+	for (int chunkY = 0; chunkY < heightmapBuffer_height - 1; chunkY += CHUNK_VERTICES - 1) {
+		for (int chunkX = 0; chunkX < heightmapBuffer_width - 1; chunkX += CHUNK_VERTICES - 1) {
+			int chunkWidth = std::min(CHUNK_VERTICES, heightmapBuffer_width - chunkX);
+			int chunkHeight = std::min(CHUNK_VERTICES, heightmapBuffer_height - chunkY);
+
+			TerrainChunk chunk;
+			chunk.vertexBuff.reserve(chunkWidth * chunkHeight);
+			for (int y = 0; y < chunkHeight; y++) {
+				const Vertex* row = &vertexBuff[((chunkY + y) * heightmapBuffer_width) + chunkX];
+				chunk.vertexBuff.insert(chunk.vertexBuff.end(), row, row + chunkWidth);
 			}
-			// The normals are initialised fine already so we can just ignore if we don't meet the above conditions
 
-			loadedPercent = loadedPercent + percentPerIteration; // Keep the user updated with a loaded percent value
+			chunk.indiciesBuff.reserve((chunkWidth - 1) * (chunkHeight - 1) * 6);
+			for (int y = 0; y < chunkHeight - 1; y++) {
+				for (int x = 0; x < chunkWidth - 1; x++) {
+					unsigned int topL = (y*chunkWidth) + x;
+					unsigned int topR = topL + 1;
+					unsigned int botL = ((y + 1)*chunkWidth) + x;
+					unsigned int botR = botL + 1;
+
+					// Do first triangle
+					chunk.indiciesBuff.push_back(botL); chunk.indiciesBuff.push_back(topR); chunk.indiciesBuff.push_back(topL);
+
+					// Do second triangle
+					chunk.indiciesBuff.push_back(botL); chunk.indiciesBuff.push_back(botR); chunk.indiciesBuff.push_back(topR);
+				}
+			}
+			chunks.push_back(std::move(chunk));
 		}
 	}
 
-	dout.verbose("Map::loadMap() --> Perfected vertex normals (" + std::to_string(normalsProcessed) + " processed)");
-
-	loadedPercent = 85.0f; // 85%
+	dout.verbose("Map::loadMap() --> Split into " + std::to_string(chunks.size()) + " chunks");
 
 	// Load the texture
 	ProtoTextureInfo textInfo;
@@ -356,12 +409,11 @@ Map::LoadingResult Map::loadMap() {
 	loadedPercent = 99.0f; // 99%
 
 	// Mark ourselves as done
-	dout.log("Map loading thread complete, exiting...");
+	dout.log("Map loading stage complete, exiting...");
 
 	// Return the result
 	result.textInfo = textInfo;
-	result.indiciesBuff = indiciesBuff;
-	result.vertexBuff = vertexBuff;
+	result.chunks = std::move(chunks);
 	result.exitValue = 0; // Valid exit
 
 	return result;
@@ -20,6 +20,8 @@ THREADING IN OPERATION, might be safe
 #include "Renderable.hpp"
 #include "LuaEngine.hpp"
 #include "MultiThreadedOpenGL.hpp"
+#include "JobSystem.hpp"
+#include "AssetManager.hpp"
 
 using namespace darksun;
 
@@ -30,6 +32,10 @@ namespace darksun {
 	public:
 		Map(string mapfolder);
 		~Map() {
+			// The loading stages work on this map, so the one running has to finish first. Maps can be destroyed on a worker, where
+			// wait() helps out
+			assets::cancel(loadingAsset);
+			assets::wait(loadingAsset);
 			dout.log("Map destructor called");
 		}
 
@@ -70,9 +76,25 @@ namespace darksun {
 			bool diffuseGammaCorrection;
 		};
 
-		struct LoadingResult {
-			std::vector<unsigned int> indiciesBuff;
+		// Greyscale heightmap, decoded from the image file
+		struct Heightmap {
+			std::vector<unsigned char> pixels;
+			int width = 0;
+			int height = 0;
+			int channels = 0;
+		};
+
+		// A square of the terrain, small enough for 16 bit indices. Neighbouring chunks share their edge vertices
+		struct TerrainChunk {
 			std::vector<Vertex> vertexBuff;
+			std::vector<unsigned int> indiciesBuff;
+		};
+
+		// Vertices along each side of a chunk, 256 * 256 is the most 16 bit indices can address
+		const static int CHUNK_VERTICES = 256;
+
+		struct LoadingResult {
+			std::vector<TerrainChunk> chunks;
 
 			ProtoTextureInfo textInfo;
 
@@ -89,9 +111,10 @@ namespace darksun {
 		string dir;
 		string luaLoc;
 
-		// Loading thread info
-		std::future<LoadingResult> loadingThreadResult;
+		// Loading info. The heightmap is read, decoded and turned into the vertex data by the asset manager
+		assets::AssetHandle loadingAsset = NULL;
 		LoadingResult result;
+		bool meshCreated = false; // Set once the loading result has been turned into a mesh
 
 		std::atomic<int> sizeX = 0;
 		std::atomic<int> sizeY = 0;
@@ -105,7 +128,9 @@ namespace darksun {
 
 		LuaEngine loadingEngine;
 
-		LoadingResult loadMap();
+		// Asset stages
+		static bool decodeHeightmap(assets::Asset& asset);
+		LoadingResult loadMap(const Heightmap& heightmap);
 	};
 
 }
\ No newline at end of file
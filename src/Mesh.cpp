@@ -12,23 +12,119 @@ Stores information on verticies and indicies and the associated memory in GPU me
 
 using namespace darksun;
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures) {
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, VertexFormat format) {
 	this->vertices = vertices;
 	this->indices = indices;
 	this->textures = textures;
+	this->format = format;
 
 	setupMesh();
 }
 
+Mesh::Mesh(const Mesh& other) : vao(other.vao), resolved(other.resolved), format(other.format), vertices(other.vertices), indices(other.indices),
+	textures(other.textures), dirtyRanges(other.dirtyRanges) {
+	retainResources();
+}
+
+Mesh::Mesh(Mesh&& other) noexcept : vao(other.vao), resolved(other.resolved), format(other.format), vertices(std::move(other.vertices)),
+	indices(std::move(other.indices)), textures(std::move(other.textures)), dirtyRanges(std::move(other.dirtyRanges)) {
+	// The references come with it
+	other.vao = 0;
+	other.textures.clear();
+}
+
+Mesh& Mesh::operator=(const Mesh& other) {
+	if (this != &other) {
+		// Retain before releasing, in case both share them
+		Mesh copy(other);
+		*this = std::move(copy);
+	}
+	return *this;
+}
+
+Mesh& Mesh::operator=(Mesh&& other) noexcept {
+	if (this != &other) {
+		releaseResources();
+		vao = other.vao;
+		resolved = other.resolved;
+		format = other.format;
+		vertices = std::move(other.vertices);
+		indices = std::move(other.indices);
+		textures = std::move(other.textures);
+		dirtyRanges = std::move(other.dirtyRanges);
+		other.vao = 0;
+		other.textures.clear();
+	}
+	return *this;
+}
+
+Mesh::~Mesh() {
+	releaseResources();
+}
+
+void Mesh::retainResources() {
+	mtopengl::retainVAO(vao);
+	for (auto const& t : textures) {
+		mtopengl::retainTexture(t.handle);
+	}
+}
+
+void Mesh::releaseResources() {
+	mtopengl::releaseVAO(vao);
+	for (auto const& t : textures) {
+		mtopengl::releaseTexture(t.handle);
+	}
+	vao = 0;
+	textures.clear();
+}
+
 void Mesh::setupMesh() {
-	myDef = mtopengl::getVAO(&vertices, &indices);
+	// Doesn't wait, the VAO is picked up in resolve() once it exists
+	vao = mtopengl::requestVAO(vertices, indices, format);
+}
+
+bool Mesh::resolve() {
+	if (resolved)
+		return true;
+
+	// Textures stream in behind a placeholder, so only the VAO has to be there
+	if (!mtopengl::isVAOReady(vao))
+		return false;
+
+	// The ids are looked up through the handles when drawing
+	resolved = true;
+	return true;
+}
+
+void Mesh::markDirty(unsigned int first, unsigned int last) {
+	last = std::min(last, (unsigned int)vertices.size());
+	if (first >= last)
+		return;
+	// Extend the last range if this carries straight on from it, which is the common case for brushes and the like
+	if (!dirtyRanges.empty() && first >= dirtyRanges.back().first && first <= dirtyRanges.back().second + DIRTY_MERGE_GAP) {
+		dirtyRanges.back().second = std::max(dirtyRanges.back().second, last);
+		return;
+	}
+	dirtyRanges.push_back(std::make_pair(first, last));
 }
 
 void Mesh::tick(float deltaTime) {
-	// Check for VBO updates
-	if (updateVBO) {
-		updateVBO = false;
+	// Check for VBO updates, these have to wait until the VAO exists
+	if (!dirtyRanges.empty() && resolved) {
+		// Merge overlapping and nearby ranges
+		std::sort(dirtyRanges.begin(), dirtyRanges.end());
+		std::vector<std::pair<unsigned int, unsigned int>> merged;
+		for (auto const& r : dirtyRanges) {
+			if (!merged.empty() && r.first <= merged.back().second + DIRTY_MERGE_GAP)
+				merged.back().second = std::max(merged.back().second, r.second);
+			else
+				merged.push_back(r);
+		}
+		dirtyRanges.clear();
 
-		mtopengl::updateVBO(myDef.ref, &vertices);
+		// Only the changed spans are copied into the command stream
+		for (auto const& r : merged) {
+			mtopengl::updateVBO(vao, vertices.data() + r.first, r.first, r.second - r.first);
+		}
 	}
 }
\ No newline at end of file
@@ -29,43 +29,65 @@ namespace darksun {
 
 	class Mesh {
 	public:
-		std::vector<Texture> getTextures() {
+		const std::vector<Texture>& getTextures() {
 			return textures;
 		}
 		int getNumberOfIndices() {
 			return indices.size();
 		}
-		
-		// This is accessed through the OpenGL thread so IS FINE RIGHT HERE
-		void GL_bindVertexArray() {
-			glBindVertexArray(myDef.VAO);
+		mtopengl::VAOHandle getVAO() {
+			return vao;
 		}
 
 		void deformVertexPosition(int vertIndex, glm::vec3 amount) {
-			if (vertIndex < vertices.size() && vertIndex > 0) {
+			if (vertIndex >= 0 && vertIndex < (int)vertices.size()) {
 				vertices[vertIndex].Position += amount;
-				updateVBO = true;
+				markDirty(vertIndex, vertIndex + 1);
 			}
 		}
 
+		// Marks the vertices in [first, last) as changed, only changed vertices are uploaded
+		void markDirty(unsigned int first, unsigned int last);
+
 		// tick function
 		void tick(float deltaTime);
 
-		// Constructor
-		Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
+		// Checks if the OpenGL thread has created the VAO. Returns true when it is ready to draw, textures stream in behind a placeholder
+		bool resolve();
+		bool isResolved() { return resolved; }
+
+		// Constructor. Takes over the reference to each texture that requestTexture() handed out. The vertices are kept in full here
+		// and packed into format on the GPU
+		Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, VertexFormat format = VertexFormat::Full);
+
+		// Copies share the GPU resources and hold their own references to them, the last mesh to go frees them
+		Mesh(const Mesh& other);
+		Mesh(Mesh&& other) noexcept;
+		Mesh& operator=(const Mesh& other);
+		Mesh& operator=(Mesh&& other) noexcept;
+		~Mesh();
 	private:
 		/*  Render data  */
-		mtopengl::VAODef myDef;
+		mtopengl::VAOHandle vao = 0;
+		bool resolved = false;
+		VertexFormat format = VertexFormat::Full;
 
 		/*  Mesh Data  */
 		std::vector<Vertex> vertices;
 		std::vector<unsigned int> indices;
 		std::vector<Texture> textures;
 
-		bool updateVBO = false;
+		// Vertex ranges [first, last) changed since the last upload, merged and uploaded on tick
+		std::vector<std::pair<unsigned int, unsigned int>> dirtyRanges;
+		// Ranges closer together than this many vertices are uploaded as one, a few extra bytes beats another command
+		const static unsigned int DIRTY_MERGE_GAP = 64;
 
 		// Construct the mesh
 		void setupMesh();
+
+		// Adds or drops this mesh's references to its VAO and textures
+		void retainResources();
+		void releaseResources();
 	};
 
 }
@@ -18,76 +18,148 @@ using namespace darksun;
 */
 
 void Model::loadModel(string const &path = "") {
+	bool gamma = getGammaCorrection();
+
+	assets::Loader loader;
+	loader.type = gamma ? "model_gamma" : "model";
+	loader.readFile = false; // Assimp reads the file itself, as formats like obj pull in other files (materials)
+	loader.decode = decodeModel;
+	loader.process = processModel;
+	// Models loaded from the same file share their meshes, so the GPU memory is counted against whoever asked first
+	mtopengl::ResourceOwner owner = mtopengl::getCurrentOwner();
+	mtopengl::CommandPriority priority = mtopengl::getCurrentPriority();
+	loader.upload = [gamma, owner, priority](assets::Asset& asset) {
+		mtopengl::OwnerScope ownerScope(owner);
+		mtopengl::PriorityScope priorityScope(priority);
+		return uploadModel(asset, gamma);
+	};
+
+	// Entities want to be seen as soon as they are spawned
+	modelAsset = assets::load(loader, path, assets::Priority::Visible);
+}
+
+void Model::tick(float deltaTime) {
+	if (!meshesAdded && modelAsset != NULL && modelAsset->isFinished()) {
+		meshesAdded = true;
+		std::shared_ptr<std::vector<Mesh>> meshes = assets::getData<std::vector<Mesh>>(modelAsset);
+		if (modelAsset->isReady() && meshes != NULL) {
+			// The copies share the GPU resources of the meshes in the asset
+			for (auto const& m : *meshes) {
+				addMesh(m);
+			}
+			setLoaded(true);
+		}
+		else {
+			dout.error("Model '" + modelAsset->path + "' failed to load");
+		}
+	}
+
+	Renderable::tick(deltaTime);
+}
+
+// WORKER
+bool Model::decodeModel(assets::Asset& asset) {
+	string path = asset.path;
+
+	std::shared_ptr<ImportedModel> imported = std::make_shared<ImportedModel>();
 	// read file via ASSIMP
-	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+	const aiScene* scene = imported->importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
 	// check for errors
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) { // if is Not Zero
 		dout.error("Scene (" + path + ") doesn't have the correct information!");
-		return;
+		return false;
 	}
 	dout.verbose("Model::loadModel -> Loaded scene '" + path + "' (plength="  + std::to_string(path.length()) + ")");
+	imported->scene = scene;
 	// retrieve the directory path of the filepath
 	try {
 		size_t pos = path.find_last_of('\\');
 		if (pos < 0 || pos >= path.size()) {
 			dout.error("LOAD MODEL ERROR: unable to parse the directory for '" + path + "' (value=" + std::to_string(pos) + ")");
-			return;
+			return false;
 		}
 		//else {
 		//	dout.verbose("Model::loadModel -> Found last / at " + std::to_string(pos));
 		//}
 		size_t zero = 0;
-		directory = path.substr(zero, pos);
+		imported->directory = path.substr(zero, pos);
 	}
 	catch (std::exception& e) {
 		string what = e.what();
 		dout.error("LOAD MODEL ERROR: " + what);
-		return;
+		return false;
 	}
-	dout.verbose("Model::loadModel -> Found directory = '" + directory + "'");
+	dout.verbose("Model::loadModel -> Found directory = '" + imported->directory + "'");
+
+	asset.data = imported;
+	return true;
+}
+
+// WORKER
+bool Model::processModel(assets::Asset& asset) {
+	std::shared_ptr<ImportedModel> imported = std::static_pointer_cast<ImportedModel>(asset.data);
+
+	std::shared_ptr<ModelData> data = std::make_shared<ModelData>();
+	data->directory = imported->directory;
 	// process ASSIMP's root node recursively
-	processNode(scene->mRootNode, scene);
+	processNode(imported->scene->mRootNode, imported->scene, *data);
+
+	// The assimp scene is released here
+	asset.data = data;
+	return true;
+}
 
-	setLoaded(true);
+// MAIN THREAD
+bool Model::uploadModel(assets::Asset& asset, bool gamma) {
+	std::shared_ptr<ModelData> data = std::static_pointer_cast<ModelData>(asset.data);
+
+	// Creating the meshes queues their VAOs and textures on the OpenGL thread
+	std::shared_ptr<std::vector<Mesh>> meshes = std::make_shared<std::vector<Mesh>>();
+	for (auto const& m : data->meshes) {
+		std::vector<Texture> textures;
+		for (auto const& t : m.textures) {
+			Texture texture;
+			texture.handle = mtopengl::requestTexture(data->directory + "/" + t.first, gamma); // the GL id is looked up through the handle when drawing
+			texture.type = t.second;
+			textures.push_back(texture);
+		}
+		meshes->push_back(Mesh(m.vertices, m.indices, textures, m.format));
+	}
+
+	asset.data = meshes;
+	return true;
 }
 
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName) {
-	std::vector<Texture> textures;
+void Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, MeshData& data) {
 	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
 		aiString str;
 		mat->GetTexture(type, i, &str);
-		Texture texture;
-		texture.id = mtopengl::getTexture(directory + "/" + str.C_Str(), getGammaCorrection());
-		texture.type = typeName;
-		texture.path = str.C_Str();
-		textures.push_back(texture);
+		data.textures.push_back(std::make_pair(string(str.C_Str()), typeName));
 
-		//dout.verbose("Model::loadMaterialTextures() --> add texture '" + typeName + "' at '" + texture.path + "'");
+		//dout.verbose("Model::loadMaterialTextures() --> add texture '" + typeName + "' at '" + str.C_Str() + "'");
 	}
-	return textures;
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
+void Model::processNode(aiNode *node, const aiScene *scene, ModelData& data) {
 	// process each mesh located at the current node
 	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
 		// the node object only contains indices to index the actual objects in the scene. 
 		// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		addMesh(processMesh(mesh, scene));
+		data.meshes.push_back(processMesh(mesh, scene));
 	}
 	// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
 	for (unsigned int i = 0; i < node->mNumChildren; i++) {
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, data);
 	}
 
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
+Model::MeshData Model::processMesh(aiMesh *mesh, const aiScene *scene) {
 	// data to fill
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> indices;
-	std::vector<Texture> textures;
+	MeshData data;
+	std::vector<Vertex>& vertices = data.vertices;
+	std::vector<unsigned int>& indices = data.indices;
 
 	// Walk through each of the mesh's vertices
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
@@ -143,18 +215,20 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
 	// normal: texture_normalN
 
 	// 1. diffuse maps
-	std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-	textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+	loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data);
 	// 2. specular maps
-	std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-	textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+	loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data);
 	// 3. normal maps
-	std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-	textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+	loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data);
 	// 4. height maps
-	std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-	textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+	loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data);
+
+	// Only normal mapping needs the tangent frame on the GPU
+	for (auto const& t : data.textures) {
+		if (t.second == "texture_normal")
+			data.format = VertexFormat::Full;
+	}
 
-	// return a mesh object created from the extracted mesh data
-	return Mesh(vertices, indices, textures);
+	// return the mesh data, the mesh itself is created on the main thread
+	return data;
 }
\ No newline at end of file
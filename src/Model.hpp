@@ -22,6 +22,7 @@ Header file for Model.cpp
 #include "Shader.hpp"
 #include "Renderable.hpp"
 #include "MultiThreadedOpenGL.hpp"
+#include "AssetManager.hpp"
 
 using string = std::string;
 using namespace darksun;
@@ -30,9 +31,6 @@ namespace darksun {
 
 	class Model : public Renderable {
 	public:
-		/*  Model Data */
-		string directory = "";
-
 		/*  Functions   */
 		// constructor
 		Model(string const &path, bool gamma = false) {
@@ -43,19 +41,53 @@ namespace darksun {
 			loadModel(p);
 		}
 
-		// MUST HAVE A GENERIC FORWARD SLASHED PATH! Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+		~Model() {
+			assets::cancel(modelAsset);
+		}
+
+		// MUST HAVE A GENERIC FORWARD SLASHED PATH! Requests a model with supported ASSIMP extensions through the asset manager, the
+		// resulting meshes are added to the meshes vector by tick() once it has loaded. Models loaded from the same file share the meshes
 		void loadModel(string const &path);
+
+		// Picks up the meshes once the model has loaded, then ticks as a renderable
+		void tick(float deltaTime);
 	private:
+		// CPU side data of a single mesh, built on a worker
+		struct MeshData {
+			std::vector<Vertex> vertices;
+			std::vector<unsigned int> indices;
+			std::vector<std::pair<string, string>> textures; // (path, type)
+			VertexFormat format = VertexFormat::Standard; // Full if it has a normal map to light with
+		};
+
+		// Held between the asset stages
+		struct ImportedModel {
+			Assimp::Importer importer;
+			const aiScene* scene = NULL;
+			string directory = "";
+		};
+		struct ModelData {
+			std::vector<MeshData> meshes;
+			string directory = "";
+		};
+
+		assets::AssetHandle modelAsset = NULL;
+		bool meshesAdded = false;
+
 		/*  Functions   */
 
+		// Asset stages. Decode imports the file, process converts the scene to our mesh data and upload creates the meshes
+		static bool decodeModel(assets::Asset& asset);
+		static bool processModel(assets::Asset& asset);
+		static bool uploadModel(assets::Asset& asset, bool gamma);
+
 		// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-		void processNode(aiNode *node, const aiScene *scene);
+		static void processNode(aiNode *node, const aiScene *scene, ModelData& data);
 
-		Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+		static MeshData processMesh(aiMesh *mesh, const aiScene *scene);
 
-		// checks all material textures of a given type and loads the textures if they're not loaded yet.
-		// the required info is returned as a Texture struct.
-		std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName);
+		// checks all material textures of a given type, the path and type of each is added to the mesh data
+		static void loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, MeshData& data);
 	};
 
 }
\ No newline at end of file
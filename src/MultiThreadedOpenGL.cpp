@@ -13,15 +13,197 @@ THREADING IN OPERATION, might be safe
 
 using namespace darksun;
 
+/**
+
+Command stream
+
+*/
+
+// Every request to the OpenGL thread goes through here, so they are carried out in the order they were made
+static mtopengl::CommandBuffer commands;
+
+// Set when there is no OpenGL thread to replay commands
+static std::atomic<bool> headless = false;
+
+// Counts calls to process(), textures remember the frame they were last drawn in. OpenGL thread only
+static unsigned long long frameNumber = 0;
+
+// Callbacks waiting on the GPU to finish the uploads issued before them, serviced at the start of every process()
+static mtopengl::CompletionQueue completions;
+
+// VBO updates are staged through here so they never stall on a VBO the GPU is still drawing from
+static mtopengl::StreamingBuffer vboStream;
+static const GLsizeiptr VBO_STREAM_SIZE = 16 * 1024 * 1024;
+
+// Texture rows are staged through here and uploaded from it as a pixel unpack buffer
+static mtopengl::StreamingBuffer pixelStream;
+static const GLsizeiptr PIXEL_STREAM_SIZE = 16 * 1024 * 1024;
+
+// How much command data the OpenGL thread replays per frame, it stops at whichever runs out first. Immediate commands aren't
+// counted, and at least one other command is replayed every frame so nothing waits forever
+static std::atomic<size_t> commandBudgetBytes = 8 * 1024 * 1024;
+static std::atomic<float> commandBudgetMs = 4.0f;
+
+// Bytes the live VAOs save by not being in the full Vertex layout, and by having 16 bit indices
+static std::atomic<size_t> vertexBytesSaved = 0;
+static std::atomic<size_t> indexBytesSaved = 0;
+
+// The class anything requested from here on by this thread is replayed in
+static thread_local mtopengl::CommandPriority currentPriority = mtopengl::CommandPriority::Visible;
+
+static void replayLoadVAO(const mtopengl::Command& command);
+static void replayUpdateVBO(const mtopengl::Command& command);
+static void replayReleaseVAO(const mtopengl::Command& command);
+static void replayUploadTexture(const mtopengl::Command& command);
+static void replayCommand(const mtopengl::Command& command);
+static string priorityToString(mtopengl::CommandPriority priority);
+static void initTextures();
+static void streamTextures();
+static void evictTextures();
+static void cleanupTextures();
+static void compactGeometry(size_t byteBudget);
+static void cleanupGeometry();
+
 void mtopengl::process() {
-	// NOTE: attempt to do functions in an order that would cause mutexes to be unlocked for a function (flip flop them)
+	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::mtopengl::process()");
+
+	// Only does anything the first time, once there is a context
+	initTextures();
+	frameNumber++;
+
+	// Whatever the GPU has finished with since last frame can be recycled before we start uploading again
+	size_t completed = completions.poll();
+
+	// Take everything recorded since last time, other threads carry on recording while we replay
+	commands.swap();
+
+	int carried = 0;
+	for (int p = 0; p < (int)CommandPriority::COUNT; p++) {
+		carried += commands.getCarriedCommandCount((CommandPriority)p);
+	}
+
+	// Most important class first, until the budget is spent. Whatever is left is replayed first next frame
+	auto start = std::chrono::steady_clock::now();
+	size_t budgetBytes = commandBudgetBytes.load();
+	float budgetMs = commandBudgetMs.load();
+	size_t replayedBytes = 0;
+	bool budgetSpent = false;
+
+	for (int p = 0; p < (int)CommandPriority::COUNT; p++) {
+		CommandPriority priority = (CommandPriority)p;
+		long long maxWaitUs = 0;
+		int replayed = 0;
+
+		mtopengl::Command command;
+		while ((priority == CommandPriority::Immediate || !budgetSpent) && commands.next(priority, command)) {
+			replayCommand(command);
+			replayed++;
+
+			auto now = std::chrono::steady_clock::now();
+			maxWaitUs = std::max(maxWaitUs, (long long)std::chrono::duration_cast<std::chrono::microseconds>(now - command.recordedAt).count());
+			if (priority != CommandPriority::Immediate) {
+				replayedBytes += command.dataSize;
+				float elapsedMs = std::chrono::duration<float, std::milli>(now - start).count();
+				budgetSpent = replayedBytes >= budgetBytes || elapsedMs >= budgetMs;
+			}
+		}
+
+		string name = priorityToString(priority);
+		profiler::addCounterToCurrentFrame("mtopengl::queued::" + name, commands.getQueuedCommandCount(priority));
+		if (replayed > 0)
+			profiler::addCounterToCurrentFrame("mtopengl::maxWaitUs::" + name, maxWaitUs);
+	}
+
+	// Textures carry on streaming in from where they left off last frame, then the least recently drawn unreferenced ones make
+	// room if we are over budget
+	streamTextures();
+	evictTextures();
 
-	// Process VAO allocations
-	processVAOLoadRequests();
-	// Process texture loads
-	processTextureLoadRequests();
-	// Process VBO updates
-	processVBOUpdateRequests();
+	// Pages left fragmented by this frame's loads are compacted with whatever budget the commands didn't use
+	compactGeometry((replayedBytes < budgetBytes) ? budgetBytes - replayedBytes : 0);
+
+	// Anything staged this frame is fenced so the rings know when they can be reused
+	vboStream.fence();
+	pixelStream.fence();
+	completions.fence();
+
+	mtopengl::reportResources();
+
+	profiler::addCounterToCurrentFrame("mtopengl::commands", commands.getReplayedCommandCount());
+	profiler::addCounterToCurrentFrame("mtopengl::commandBytes", commands.getReplayedByteCount());
+	profiler::addCounterToCurrentFrame("mtopengl::carriedCommands", carried);
+	profiler::addCounterToCurrentFrame("mtopengl::completions", (long long)completed);
+	profiler::addCounterToCurrentFrame("mtopengl::pendingCompletions", (long long)completions.getPendingCount());
+	profiler::addCounterToCurrentFrame("mtopengl::vertexBytesSaved", vertexBytesSaved.load());
+	profiler::addCounterToCurrentFrame("mtopengl::indexBytesSaved", indexBytesSaved.load());
+}
+
+static void replayCommand(const mtopengl::Command& command) {
+	switch (command.type) {
+	case mtopengl::CommandType::LoadVAO:
+		replayLoadVAO(command);
+		break;
+	case mtopengl::CommandType::UpdateVBO:
+		replayUpdateVBO(command);
+		break;
+	case mtopengl::CommandType::ReleaseVAO:
+		replayReleaseVAO(command);
+		break;
+	case mtopengl::CommandType::UploadTexture:
+		replayUploadTexture(command);
+		break;
+	default:
+		dout.error("OpenGL --> Unknown command type " + std::to_string((int)command.type) + " in the command stream");
+		break;
+	}
+}
+
+static string priorityToString(mtopengl::CommandPriority priority) {
+	switch (priority) {
+	case mtopengl::CommandPriority::Immediate: return "immediate";
+	case mtopengl::CommandPriority::Terrain: return "terrain";
+	case mtopengl::CommandPriority::Visible: return "visible";
+	case mtopengl::CommandPriority::Background: return "background";
+	default: return "unknown";
+	}
+}
+
+void mtopengl::setCommandBudget(size_t bytes, float milliseconds) {
+	commandBudgetBytes = bytes;
+	commandBudgetMs = milliseconds;
+}
+
+mtopengl::PriorityScope::PriorityScope(CommandPriority priority) {
+	previous = currentPriority;
+	currentPriority = priority;
+}
+
+mtopengl::PriorityScope::~PriorityScope() {
+	currentPriority = previous;
+}
+
+mtopengl::CommandPriority mtopengl::getCurrentPriority() {
+	return currentPriority;
+}
+
+void mtopengl::whenUploadsComplete(std::function<void()> callback) {
+	completions.whenComplete(callback);
+}
+
+void mtopengl::cleanup() {
+	// Everything waiting on the GPU goes first, it may hand buffers back to the rings and the pool
+	completions.finish();
+	vboStream.cleanup();
+	cleanupTextures();
+	cleanupGeometry();
+}
+
+void mtopengl::setHeadless(bool h) {
+	headless = h;
+}
+
+bool mtopengl::isHeadless() {
+	return headless.load();
 }
 
 /**
@@ -30,128 +212,315 @@ sf::Event handling
 
 */
 
-static std::mutex eventQueue_mutex = std::mutex();
-static std::vector<sf::Event> eventQueue = std::vector<sf::Event>();
+// Written by the opengl thread, read by the main thread
+static SPSCQueue<sf::Event, 1024> eventQueue;
+
+static std::atomic<unsigned long long> droppedEvents = 0;
+static std::atomic<unsigned long long> coalescedEvents = 0;
 
-std::vector<sf::Event> mtopengl::getEvents() {
-	std::lock_guard lock(eventQueue_mutex);
-	std::vector<sf::Event> retEvents = eventQueue;
-	eventQueue.clear();
-	return retEvents;
+// Only touched by the opengl thread
+static bool hasPendingMouseMove = false;
+static sf::Event pendingMouseMove;
+static bool droppingEvents = false;
+
+static void pushEvent(sf::Event& e) {
+	if (eventQueue.push(e)) {
+		droppingEvents = false;
+		return;
+	}
+
+	droppedEvents++;
+	if (!droppingEvents) {
+		// Only warn once per run of drops, the main thread is stalled and there could be a lot of them
+		dout.warn("OpenGL --> Event queue full, dropping events (" + std::to_string(droppedEvents.load()) + " dropped in total)");
+		droppingEvents = true;
+	}
+}
+
+int mtopengl::getEvents(sf::Event* buffer, int max) {
+	if (max <= 0)
+		return 0;
+	return eventQueue.pop(buffer, max);
 }
 
 void mtopengl::addEvent(sf::Event e) {
-	std::lock_guard lock(eventQueue_mutex);
-	eventQueue.push_back(e);
+	if (e.type == sf::Event::MouseMoved) {
+		// Hold on to it, if another mouse move comes straight after this one it replaces it
+		if (hasPendingMouseMove)
+			coalescedEvents++;
+		pendingMouseMove = e;
+		hasPendingMouseMove = true;
+		return;
+	}
+
+	// Keep the ordering, the held mouse move happened before this event
+	flushEvents();
+	pushEvent(e);
 	//dout.verbose("Detected event " + std::to_string(e.type) + " with queue length (post-addition) = " + std::to_string(eventQueue.size()));
 }
 
+void mtopengl::flushEvents() {
+	if (hasPendingMouseMove) {
+		hasPendingMouseMove = false;
+		pushEvent(pendingMouseMove);
+	}
+}
+
+unsigned long long mtopengl::getDroppedEventCount() {
+	return droppedEvents.load();
+}
+
+unsigned long long mtopengl::getCoalescedEventCount() {
+	return coalescedEvents.load();
+}
+
 /**
 
 VAO Loading
 
 */
-static std::mutex loadingVAOs_mutex = std::mutex();
 
-static std::vector<mtopengl::VAODef> vaosToLoad = std::vector<mtopengl::VAODef>();
+struct LoadVAOPayload {
+	mtopengl::VAOHandle handle;
+	VertexFormat format;
+	GLenum indexType;
+	unsigned int numVertices;
+	unsigned int numIndices;
+};
+
+// Handles are handed out by the requesting threads, the definitions are written by the OpenGL thread
+static SlotMap<mtopengl::VAODef> vaoTable;
+
+static std::mutex vaoRefs_mutex = std::mutex();
+
+// References held to every live VAO, the last release deletes it on the OpenGL thread
+struct VAORecord {
+	int refs = 0;
+	mtopengl::ResourceOwner owner;
+	mtopengl::ResourceType type = mtopengl::ResourceType::Geometry;
+	size_t bytes = 0;
+	// Everything recorded for the VAO goes in the class it was loaded in, so it is replayed after the load
+	mtopengl::CommandPriority priority = mtopengl::CommandPriority::Visible;
+	VertexFormat format = VertexFormat::Full;
+	size_t vertexBytesSaved = 0; // Against the full Vertex layout and 32 bit indices
+	size_t indexBytesSaved = 0;
+};
+static std::unordered_map<mtopengl::VAOHandle, VAORecord> vaoRefs = std::unordered_map<mtopengl::VAOHandle, VAORecord>();
+
+struct ReleaseVAOPayload {
+	mtopengl::VAOHandle handle;
+};
+
+// Compaction moved a mesh within its page
+static void geometryMoved(uint32_t owner, const mtopengl::GeometryAllocation& allocation);
+
+// Mesh geometry is packed in here, 32MB of vertices and 16MB of indices a page. OpenGL thread only
+static mtopengl::GeometryPool geometryPool(32 * 1024 * 1024, 16 * 1024 * 1024, geometryMoved);
+
+static void geometryMoved(uint32_t owner, const mtopengl::GeometryAllocation& allocation) {
+	mtopengl::VAODef* def = vaoTable.get(owner);
+	if (def == NULL)
+		return; // Still being created, it gets the new offsets from allocate()
+	def->VBO = geometryPool.getVBO(allocation.page);
+	def->EBO = geometryPool.getEBO(allocation.page);
+	def->baseVertex = allocation.baseVertex;
+	def->firstIndex = allocation.firstIndex;
+}
 
-static std::map<int, mtopengl::VAODef> loadedVAOs = std::map<int, mtopengl::VAODef>();
+static void compactGeometry(size_t byteBudget) {
+	geometryPool.compactPending(byteBudget);
+}
 
-static unsigned int VAO_REF_COUNTER = 0;
+static void cleanupGeometry() {
+	geometryPool.cleanup();
+}
 
-mtopengl::VAODef mtopengl::getVAO(std::vector<Vertex>* vertices, std::vector<unsigned int>* indices) {
-	unsigned int ref = ++VAO_REF_COUNTER;
-	
-	unsigned int vaoId = 0;
-	int countLoaded = 0;
-	// Get the number of vaos loaded with this filename
-	{
-		std::lock_guard lock(loadingVAOs_mutex);
-		countLoaded = loadedVAOs.count(ref);
+mtopengl::VAOHandle mtopengl::requestVAO(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, VertexFormat format) {
+	mtopengl::VAOHandle handle = vaoTable.allocate();
+	if (handle == 0) {
+		dout.error("OpenGL --> VAO table is full");
+		return handle;
 	}
-
-	if (countLoaded == 0) {
-		dout.log("OpenGL --> Got request for VAO with ref \"" + std::to_string(ref) + "\" which is not yet loaded, loading now");
-
-		// There are none loaded, schedule one for loading
-		mtopengl::VAODef def;
-		def.ref = ref;
-		def.vertices = std::vector<Vertex>(*vertices);
-		def.indices = std::vector<unsigned int>(*indices);
-		// add to the loading vector
-		{
-			std::lock_guard lock(loadingVAOs_mutex);
-			vaosToLoad.push_back(def);
-		}
-
-		// Now we wait until the loaded count goes above 0
-		while (countLoaded == 0) {
-			{
-				std::lock_guard lock(loadingVAOs_mutex);
-				countLoaded = loadedVAOs.count(ref);
-			}
-			using namespace std::chrono_literals;
-			std::this_thread::sleep_for(1ms);
-		}
+	VAORecord record;
+	record.refs = 1;
+	record.priority = currentPriority;
+	record.format = format;
+	size_t vertexSize = mtopengl::getVertexSize(format);
+	GLenum indexType = mtopengl::chooseIndexType(vertices.size());
+	size_t indexSize = mtopengl::getIndexSize(indexType);
+	if (!headless) {
+		// Counted against whoever asked for it, on top of the page if it shares one
+		record.owner = mtopengl::getCurrentOwner();
+		record.type = geometryPool.canShare(format, indexType, vertices.size(), indices.size()) ? ResourceType::PooledGeometry : ResourceType::Geometry;
+		record.bytes = vertices.size() * vertexSize + indices.size() * indexSize;
+		record.vertexBytesSaved = vertices.size() * (sizeof(Vertex) - vertexSize);
+		record.indexBytesSaved = indices.size() * (sizeof(unsigned int) - indexSize);
+		mtopengl::addResource(record.type, record.owner, record.bytes);
+		vertexBytesSaved += record.vertexBytesSaved;
+		indexBytesSaved += record.indexBytesSaved;
+	}
+	{
+		std::lock_guard lock(vaoRefs_mutex);
+		vaoRefs[handle] = record;
 	}
 
-	// It is loaded, set the return value and return
-	std::lock_guard lock(loadingVAOs_mutex);
-	vaoId = loadedVAOs[ref].VAO;
-
-	// Do a check on the return value
-	if (vaoId == 0) {
-		// NULL!
-		dout.error("getVAO() is about to return a null pointer for VAO ref \"" + std::to_string(ref) + "\"");
+	if (headless) {
+		// Nothing will ever draw it
+		vaoTable.publish(handle, mtopengl::VAODef());
+		return handle;
 	}
 
-	return loadedVAOs[ref];
+	LoadVAOPayload payload;
+	payload.handle = handle;
+	payload.format = format;
+	payload.indexType = indexType;
+	payload.numVertices = vertices.size();
+	payload.numIndices = indices.size();
+	// The vertices and indices are packed straight into the command, one after the other
+	size_t verticesSize = vertices.size() * vertexSize;
+	commands.recordWith(CommandType::LoadVAO, record.priority, payload, verticesSize + indices.size() * indexSize, [&](unsigned char* data) {
+		mtopengl::packVertices(format, vertices.data(), vertices.size(), data);
+		mtopengl::packIndices(indexType, indices.data(), indices.size(), data + verticesSize);
+	});
+
+	return handle;
 }
 
-void mtopengl::processVAOLoadRequests() {
-	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::mtopengl::processVAOLoadRequests()");
-	// Acquire the locks for the duration of the processing
-	std::lock_guard lock(loadingVAOs_mutex);
-
-	for (auto const& e : vaosToLoad) {
-		mtopengl::VAODef def = e;
-		// Do the load
-		
+static void replayLoadVAO(const mtopengl::Command& command) {
+	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::replayLoadVAO()");
+	const LoadVAOPayload& payload = command.getPayload<LoadVAOPayload>();
+
+	size_t vertexSize = mtopengl::getVertexSize(payload.format);
+	size_t indexSize = mtopengl::getIndexSize(payload.indexType);
+	const unsigned char* vertices = command.data;
+	const unsigned char* indices = command.data + (payload.numVertices * vertexSize);
+
+	mtopengl::VAODef def;
+	def.format = payload.format;
+	def.indexType = payload.indexType;
+	def.VBOSize = payload.numVertices * vertexSize;
+	def.EBOSize = payload.numIndices * indexSize;
+	def.numIndices = payload.numIndices;
+
+	if (!vboStream.isInitialised())
+		vboStream.init(VBO_STREAM_SIZE, &completions);
+
+	mtopengl::GeometryAllocation allocation;
+	if (geometryPool.allocate(payload.handle, payload.format, payload.indexType, payload.numVertices, payload.numIndices, allocation)) {
+		// Shares a page, the data goes in through the staging ring as other meshes in the page may be being drawn from
+		def.page = allocation.page;
+		def.VAO = geometryPool.getVAO(allocation.page);
+		def.VBO = geometryPool.getVBO(allocation.page);
+		def.EBO = geometryPool.getEBO(allocation.page);
+		def.baseVertex = allocation.baseVertex;
+		def.firstIndex = allocation.firstIndex;
+		vboStream.upload(def.VBO, (GLintptr)def.baseVertex * vertexSize, vertices, def.VBOSize);
+		vboStream.upload(def.EBO, (GLintptr)def.firstIndex * indexSize, indices, def.EBOSize);
+	}
+	else {
+		// Too big to share, it gets buffers of its own
 		glGenVertexArrays(1, &def.VAO);
 		glGenBuffers(1, &def.VBO);
 		glGenBuffers(1, &def.EBO);
 
 		glBindVertexArray(def.VAO);
 
-		def.VBOSize = def.vertices.size() * sizeof(Vertex);
 		glBindBuffer(GL_ARRAY_BUFFER, def.VBO);
-		glBufferData(GL_ARRAY_BUFFER, def.VBOSize, &def.vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, def.VBOSize, vertices, GL_STATIC_DRAW);
 
-		def.EBOSize = def.indices.size() * sizeof(unsigned int);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, def.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, def.EBOSize, &def.indices[0], GL_STATIC_DRAW);
-
-		// vertex positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, def.EBOSize, indices, GL_STATIC_DRAW);
+
+		mtopengl::setupVertexFormat(payload.format);
 
 		glBindVertexArray(0);
+	}
 
-		// CLEAR THE VECTORS
-		def.vertices.clear();
-		def.indices.clear();
-		// Put the def in the loadedVAOs map
-		loadedVAOs[def.ref] = def;
+	if (def.VAO == 0) {
+		// NULL!
+		dout.error("replayLoadVAO() created a null VAO for handle \"" + std::to_string(payload.handle) + "\"");
 	}
 
-	// clear the toLoad pile
-	vaosToLoad.clear();
+	// Store the def and let the requester know
+	vaoTable.publish(payload.handle, def);
+}
+
+bool mtopengl::isVAOReady(VAOHandle handle) {
+	return vaoTable.isReady(handle);
+}
+
+const mtopengl::VAODef* mtopengl::getVAO(VAOHandle handle) {
+	return vaoTable.get(handle);
+}
+
+void mtopengl::retainVAO(VAOHandle handle) {
+	if (handle == 0)
+		return;
+	std::lock_guard lock(vaoRefs_mutex);
+	auto it = vaoRefs.find(handle);
+	if (it != vaoRefs.end())
+		it->second.refs++;
+}
+
+void mtopengl::releaseVAO(VAOHandle handle) {
+	if (handle == 0)
+		return;
+	CommandPriority priority;
+	{
+		std::lock_guard lock(vaoRefs_mutex);
+		auto it = vaoRefs.find(handle);
+		if (it == vaoRefs.end() || --it->second.refs > 0)
+			return;
+		if (it->second.bytes > 0)
+			mtopengl::removeResource(it->second.type, it->second.owner, it->second.bytes);
+		vertexBytesSaved -= it->second.vertexBytesSaved;
+		indexBytesSaved -= it->second.indexBytesSaved;
+		priority = it->second.priority;
+		vaoRefs.erase(it);
+	}
+
+	if (headless) {
+		vaoTable.release(handle);
+		return;
+	}
+
+	// Deleted when the OpenGL thread gets to it, after anything recorded for it before now
+	ReleaseVAOPayload payload;
+	payload.handle = handle;
+	commands.record(CommandType::ReleaseVAO, priority, payload);
+}
+
+void mtopengl::retainVAOs(const std::vector<VAOHandle>& handles) {
+	std::lock_guard lock(vaoRefs_mutex);
+	for (VAOHandle handle : handles) {
+		auto it = vaoRefs.find(handle);
+		if (it != vaoRefs.end())
+			it->second.refs++;
+	}
+}
+
+void mtopengl::releaseVAOs(const std::vector<VAOHandle>& handles) {
+	for (VAOHandle handle : handles) {
+		releaseVAO(handle);
+	}
+}
+
+static void replayReleaseVAO(const mtopengl::Command& command) {
+	const ReleaseVAOPayload& payload = command.getPayload<ReleaseVAOPayload>();
+
+	mtopengl::VAODef* def = vaoTable.get(payload.handle);
+	if (def != NULL && def->page >= 0) {
+		// The range may still be read by frames in flight, so it is only handed out again once the GPU is past them
+		mtopengl::VAOHandle handle = payload.handle;
+		int page = def->page;
+		completions.whenComplete([handle, page]() { geometryPool.free(handle, page); });
+	}
+	else if (def != NULL) {
+		glDeleteVertexArrays(1, &def->VAO);
+		glDeleteBuffers(1, &def->VBO);
+		glDeleteBuffers(1, &def->EBO);
+	}
+	vaoTable.release(payload.handle);
 }
 
 /**
@@ -159,48 +528,61 @@ void mtopengl::processVAOLoadRequests() {
 VAO Updating
 
 */
-// We use the loadingVAOs mutex for these functions
 
-static std::vector<mtopengl::VBOUpdateDef> vbosToUpdate = std::vector<mtopengl::VBOUpdateDef>();
+struct UpdateVBOPayload {
+	mtopengl::VAOHandle vao;
+	unsigned int firstVertex;
+	unsigned int numVertices;
+};
 
-void mtopengl::updateVBO(int vaoRef, std::vector<Vertex>* vertices) {
+void mtopengl::updateVBO(VAOHandle vao, const Vertex* vertices, unsigned int firstVertex, unsigned int count) {
 	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::mtopengl::updateVBO()");
-	// Acquire the locks for the duration of the processing
-	std::lock_guard lock(loadingVAOs_mutex);
 
-	// Check to see if the VAO exists:
-	if(loadedVAOs.count(vaoRef) <= 0) {
-		dout.error("MultiThreadedOpenGL.cpp::mtopengl::updateVBO() --> Attempted to add VBO update of VAORef='" + std::to_string(vaoRef) + "' where such VAORef doesn't exist");
+	if (headless || count == 0)
 		return;
+	CommandPriority priority = CommandPriority::Visible;
+	VertexFormat format = VertexFormat::Full;
+	{
+		std::lock_guard lock(vaoRefs_mutex);
+		auto it = vaoRefs.find(vao);
+		if (it != vaoRefs.end()) {
+			priority = it->second.priority;
+			format = it->second.format;
+		}
 	}
-	
-	VBOUpdateDef def;
-	def.vaoDefRef = vaoRef;
-	def.vertices = std::vector<Vertex>(*vertices);
-
-	vbosToUpdate.push_back(def);
+	UpdateVBOPayload payload;
+	payload.vao = vao;
+	payload.firstVertex = firstVertex;
+	payload.numVertices = count;
+	// Packed into the VAO's layout straight into the command, so the OpenGL thread copies it straight in
+	commands.recordWith(CommandType::UpdateVBO, priority, payload, count * mtopengl::getVertexSize(format), [&](unsigned char* data) {
+		mtopengl::packVertices(format, vertices, count, data);
+	});
 }
 
-void mtopengl::processVBOUpdateRequests() {
-	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::mtopengl::processVBOUpdateRequests()");
-	// Acquire the locks for the duration of the processing
-	std::lock_guard lock(loadingVAOs_mutex);
-
-	for (auto& def : vbosToUpdate) {
-		// VAOref is assumed to exist, otherwise it wouldn't have made it into the list
-		glBindVertexArray(loadedVAOs[def.vaoDefRef].VAO);
+static void replayUpdateVBO(const mtopengl::Command& command) {
+	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::replayUpdateVBO()");
+	const UpdateVBOPayload& payload = command.getPayload<UpdateVBOPayload>();
 
-		// bind the VBO we want to update
-		glBindBuffer(GL_ARRAY_BUFFER, loadedVAOs[def.vaoDefRef].VBO);
+	// Check to see if the VAO exists, it will if it was requested before this update was recorded and hasn't been freed since
+	mtopengl::VAODef* def = vaoTable.get(payload.vao);
+	if (def == NULL) {
+		dout.error("MultiThreadedOpenGL.cpp::replayUpdateVBO() --> Attempted VBO update of VAO handle '" + std::to_string(payload.vao) + "' which doesn't exist or is stale");
+		return;
+	}
 
-		// Do the data swap
-		glBufferSubData(GL_ARRAY_BUFFER, 0, loadedVAOs[def.vaoDefRef].VBOSize, &def.vertices[0]);
+	// Never past the end of the mesh's vertices, which may share the buffer with other meshes
+	size_t vertexSize = mtopengl::getVertexSize(def->format);
+	unsigned int offset = payload.firstVertex * vertexSize;
+	if (offset >= def->VBOSize)
+		return;
+	unsigned int size = std::min((unsigned int)command.dataSize, def->VBOSize - offset);
 
-		// Unbind
-		glBindVertexArray(0);
-	}
+	if (!vboStream.isInitialised())
+		vboStream.init(VBO_STREAM_SIZE, &completions);
+	vboStream.upload(def->VBO, (GLintptr)def->baseVertex * vertexSize + offset, command.data, size);
 
-	vbosToUpdate.clear();
+	profiler::addCounterToCurrentFrame("mtopengl::vboUpdateBytes", size);
 }
 
 
@@ -209,120 +591,487 @@ void mtopengl::processVBOUpdateRequests() {
 Texture Loading
 
 */
-static std::mutex loadingTextures_mutex = std::mutex();
 
-static std::vector<mtopengl::TextureDef> texturesToLoad = std::vector<mtopengl::TextureDef>();
+// A texture the OpenGL thread is part way through streaming in
+struct PendingTexture {
+	TextureHandle handle = 0;
+	bool gamma = false;
+	mtopengl::CommandPriority priority = mtopengl::CommandPriority::Visible; // Streamed in before anything less important
+	std::shared_ptr<texcache::TextureData> data; // Mapped from the texture cache, or built on the workers
+	unsigned int id = 0;	// 0 until the storage has been created
+	int level = 0;			// Mip level being streamed, and how far through it we are
+	int rowsUploaded = 0;
+};
+
+// The decoded pixels wait in the texture's record until this is replayed, so a command that never is leaks nothing
+struct UploadTexturePayload {
+	TextureHandle handle;
+	bool gamma;
+	mtopengl::CommandPriority priority;
+};
+
+// A texture on the GPU
+struct ResidentTexture {
+	unsigned int id = 0;
+	size_t bytes = 0;
+	unsigned long long lastUsed = 0; // Frame it was last drawn in
+};
+
+// Who wants a texture. It is counted against the owner that first asked for it, or the texture cache while nobody does
+struct TextureRecord {
+	uint64_t key = 0;
+	int refs = 0;
+	mtopengl::ResourceOwner owner;
+	size_t bytes = 0; // 0 until it is resident
+	bool failed = false; // It will never be ready and is drawn with the placeholder
+	// Decoded mip chain waiting for its UploadTexture command, taken by the OpenGL thread when it is replayed
+	std::shared_ptr<texcache::TextureData> staged;
+};
+
+// Handles are handed out by the requesting threads, the textures are written by the OpenGL thread
+static SlotMap<ResidentTexture> textureTable;
+
+// Guards requestedTextures and textureRecords
+static std::mutex requestedTextures_mutex = std::mutex();
+
+// Every texture that has been requested and not evicted, loaded or not, by the FNV-1a hash of the filename
+static std::unordered_map<uint64_t, TextureHandle> requestedTextures = std::unordered_map<uint64_t, TextureHandle>();
+static std::unordered_map<TextureHandle, TextureRecord> textureRecords = std::unordered_map<TextureHandle, TextureRecord>();
+
+// OpenGL thread only. Every texture on the GPU and the memory they take between them
+static std::vector<TextureHandle> residentTextures = std::vector<TextureHandle>();
+static size_t residentTextureBytes = 0;
+static std::atomic<size_t> textureBudgetBytes = (size_t)512 * 1024 * 1024;
+
+// OpenGL thread only. Textures waiting to be streamed in, most important first then oldest first
+static std::deque<PendingTexture> pendingTextures = std::deque<PendingTexture>();
+
+// Bound in place of any texture that isn't ready yet
+static unsigned int placeholderTexture = 0;
+
+// How much texture data the OpenGL thread streams in per frame
+static std::atomic<size_t> uploadBudgetBytes = 4 * 1024 * 1024;
+static std::atomic<float> uploadBudgetMs = 2.0f;
+
+static uint64_t hashFilename(const string& filename) {
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : filename) {
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
 
-static std::map<string, mtopengl::TextureDef> loadedTextures = std::map<string, mtopengl::TextureDef>();
+static bool decodeImage(assets::Asset& asset) {
+	// The cache already has the whole mip chain if it was built from these exact bytes
+	uint64_t sourceHash = texcache::hashBytes(asset.bytes.data(), asset.bytes.size());
+	std::shared_ptr<texcache::TextureData> texture = texcache::load(asset.path, sourceHash);
+	if (texture != NULL) {
+		asset.data = texture;
+		return true;
+	}
+
+	// First load, or the source has changed since it was cached
+	int width, height, nrComponents;
+	unsigned char* data = stbi_load_from_memory((const stbi_uc*)asset.bytes.data(), (int)asset.bytes.size(), &width, &height, &nrComponents, 0);
+	if (data == NULL) {
+		dout.error("Texture failed to decode at path: " + asset.path + " (" + string(stbi_failure_reason()) + ")");
+		return false;
+	}
+
+	texture = texcache::build(data, width, height, nrComponents);
+	stbi_image_free(data);
+	texcache::store(asset.path, sourceHash, *texture);
+
+	asset.data = texture;
+	return true;
+}
 
-unsigned int mtopengl::getTexture(const string filename, bool gamma) {
-	unsigned int textId = 0;
-	int countLoaded = 0;
-	// Get the number of textures loaded with this filename
+// Marks a texture that will never be ready. Anything drawing it keeps the placeholder, and the next request for the file tries again
+static void failTexture(TextureHandle handle, const string& reason) {
+	dout.error("OpenGL --> Texture " + std::to_string(handle) + " failed to load (" + reason + "), it is drawn with the placeholder");
+	std::lock_guard lock(requestedTextures_mutex);
+	auto record = textureRecords.find(handle);
+	if (record == textureRecords.end())
+		return;
+	record->second.failed = true;
+	record->second.staged = NULL;
+	auto requested = requestedTextures.find(record->second.key);
+	if (requested != requestedTextures.end() && requested->second == handle)
+		requestedTextures.erase(requested);
+	if (record->second.refs == 0) {
+		textureRecords.erase(record);
+		textureTable.release(handle);
+	}
+}
+
+TextureHandle mtopengl::requestTexture(const string filename, bool gamma) {
+	// Hashed before taking the lock, the lock only covers the table lookup
+	uint64_t key = hashFilename(filename);
+	TextureHandle handle = 0;
 	{
-		std::lock_guard lock(loadingTextures_mutex);
-		countLoaded = loadedTextures.count(filename);
+		std::lock_guard lock(requestedTextures_mutex);
+
+		// Share the handle if someone has already asked for this file
+		auto existing = requestedTextures.find(key);
+		if (existing != requestedTextures.end()) {
+			TextureRecord& record = textureRecords[existing->second];
+			if (record.refs++ == 0) {
+				// Picked back up from the texture cache
+				if (record.bytes > 0) {
+					mtopengl::removeResource(ResourceType::Texture, mtopengl::getTextureCacheOwner(), record.bytes);
+					mtopengl::addResource(ResourceType::Texture, mtopengl::getCurrentOwner(), record.bytes);
+				}
+				record.owner = mtopengl::getCurrentOwner();
+			}
+			return existing->second;
+		}
+
+		handle = textureTable.allocate();
+		if (handle == 0) {
+			dout.error("OpenGL --> Texture table is full");
+			return handle;
+		}
+		requestedTextures[key] = handle;
+		TextureRecord record;
+		record.key = key;
+		record.refs = 1;
+		record.owner = mtopengl::getCurrentOwner();
+		textureRecords[handle] = record;
+	}
+
+	if (headless) {
+		// Nothing will ever draw it
+		textureTable.publish(handle, ResidentTexture());
+		return handle;
 	}
 
-	if (countLoaded == 0) {
-		dout.log("OpenGL --> Got request for texture \"" + filename + "\" which is not yet loaded, loading now");
+	dout.log("OpenGL --> Got request for texture \"" + filename + "\" which is not yet loaded, loading now");
+
+	// Read and decoded (or mapped from the texture cache) on the workers, the mip chain is then handed to the OpenGL thread to stream in. Until it has been,
+	// drawing it binds the placeholder
+	assets::Loader loader;
+	loader.type = "texture";
+	loader.decode = decodeImage;
+	CommandPriority priority = currentPriority;
+	loader.upload = [handle, gamma, priority](assets::Asset& asset) {
+		std::shared_ptr<texcache::TextureData> data = std::static_pointer_cast<texcache::TextureData>(asset.data);
+		if (data == NULL)
+			return false;
 
-		// There are none loaded, schedule one for loading
-		mtopengl::TextureDef def;
-		def.filename = filename;
-		def.gamma = gamma;
-		// add to the loading vector
 		{
-			std::lock_guard lock(loadingTextures_mutex);
-			texturesToLoad.push_back(def);
+			// Staged with the record until the OpenGL thread takes it
+			std::lock_guard lock(requestedTextures_mutex);
+			auto record = textureRecords.find(handle);
+			if (record == textureRecords.end())
+				return false;
+			record->second.staged = data;
 		}
+		asset.data = NULL;
+
+		UploadTexturePayload payload;
+		payload.handle = handle;
+		payload.gamma = gamma;
+		payload.priority = priority;
+		commands.record(CommandType::UploadTexture, CommandPriority::Immediate, payload);
+		return true;
+	};
+	loader.failed = [handle, filename](assets::Asset&) {
+		failTexture(handle, "'" + filename + "' could not be read or decoded");
+	};
+	// The handle is already shared through requestedTextures, and the loader captures it
+	assets::load(loader, filename, (priority == CommandPriority::Background) ? assets::Priority::Prefetch : assets::Priority::Visible, false);
+
+	return handle;
+}
+
+static void replayUploadTexture(const mtopengl::Command& command) {
+	const UploadTexturePayload& payload = command.getPayload<UploadTexturePayload>();
+	PendingTexture texture;
+	texture.handle = payload.handle;
+	texture.gamma = payload.gamma;
+	texture.priority = payload.priority;
+	{
+		std::lock_guard lock(requestedTextures_mutex);
+		auto record = textureRecords.find(payload.handle);
+		if (record != textureRecords.end())
+			texture.data = std::move(record->second.staged);
+	}
+	if (texture.data == NULL || texture.data->levels.empty()) {
+		failTexture(payload.handle, "nothing was staged for it");
+		return;
+	}
+
+	// Streamed in by streamTextures() as the budget allows, after everything as or more important
+	auto after = std::find_if(pendingTextures.begin(), pendingTextures.end(), [&](const PendingTexture& t) { return t.priority > texture.priority; });
+	pendingTextures.insert(after, std::move(texture));
+}
+
+static GLenum textureFormat(int channels) {
+	switch (channels) {
+	case 1: return GL_RED;
+	case 2: return GL_RG;
+	case 3: return GL_RGB;
+	default: return GL_RGBA;
+	}
+}
 
-		using namespace std::chrono_literals;
-		std::this_thread::sleep_for(1ms);
+static void initTextures() {
+	if (placeholderTexture != 0)
+		return;
+
+	pixelStream.init(PIXEL_STREAM_SIZE);
+
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+	glGenTextures(1, &placeholderTexture);
+	glBindTexture(GL_TEXTURE_2D, placeholderTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Creates the storage for every mip level of the texture, the rows are filled in afterwards
+static void createTextureStorage(PendingTexture& texture) {
+	const texcache::TextureData& data = *texture.data;
+	GLenum format = textureFormat(data.channels);
+	glGenTextures(1, &texture.id);
+	glBindTexture(GL_TEXTURE_2D, texture.id);
+	for (size_t i = 0; i < data.levels.size(); i++) {
+		glTexImage2D(GL_TEXTURE_2D, (GLint)i, format, data.levels[i].width, data.levels[i].height, 0, format, GL_UNSIGNED_BYTE, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)data.levels.size() - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// Streams pending textures in through the pixel ring, a band of rows of one mip level at a time, until this frame's budget is
+// spent. Big textures are spread over several frames, each one is published once the last row of its last level is in
+static void streamTextures() {
+	if (pendingTextures.empty())
+		return;
+	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::streamTextures()");
+
+	auto start = std::chrono::steady_clock::now();
+	size_t budgetBytes = uploadBudgetBytes.load();
+	float budgetMs = uploadBudgetMs.load();
+	size_t uploadedBytes = 0;
+	int completed = 0;
+
+	// Rows are tightly packed, whatever the channel count
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	while (!pendingTextures.empty() && uploadedBytes < budgetBytes) {
+		PendingTexture& texture = pendingTextures.front();
+		const texcache::TextureData& data = *texture.data;
+		const texcache::MipLevel& level = data.levels[texture.level];
+
+		if (texture.id == 0)
+			createTextureStorage(texture);
+		else
+			glBindTexture(GL_TEXTURE_2D, texture.id);
+
+		size_t rowBytes = (size_t)level.width * data.channels;
+		int remainingRows = level.height - texture.rowsUploaded;
+		// At least one row so every texture makes progress, then as many as the budget and the ring allow
+		size_t allowed = std::min(budgetBytes - uploadedBytes, (size_t)pixelStream.getCapacity() / 2);
+		int rows = std::clamp((int)(allowed / std::max(rowBytes, (size_t)1)), 1, remainingRows);
+		size_t bandBytes = rowBytes * rows;
+		const unsigned char* band = data.getLevel(texture.level) + rowBytes * texture.rowsUploaded;
+		GLenum format = textureFormat(data.channels);
+
+		GLsizeiptr offset = pixelStream.stage(band, (GLsizeiptr)bandBytes);
+		if (offset >= 0) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelStream.getBuffer());
+			glTexSubImage2D(GL_TEXTURE_2D, texture.level, 0, texture.rowsUploaded, level.width, rows, format, GL_UNSIGNED_BYTE, (const void*)(intptr_t)offset);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		else {
+			// A single row too wide for the ring, or no ring at all
+			glTexSubImage2D(GL_TEXTURE_2D, texture.level, 0, texture.rowsUploaded, level.width, rows, format, GL_UNSIGNED_BYTE, band);
+		}
+		texture.rowsUploaded += rows;
+		uploadedBytes += bandBytes;
 
-		// Now we wait until the loaded count goes above 0
-		dout.verbose("OpenGL --> Waiting for the texture....");
-		while (countLoaded == 0) {
+		if (texture.rowsUploaded >= level.height) {
+			texture.level++;
+			texture.rowsUploaded = 0;
+		}
+		if (texture.level >= (int)data.levels.size()) {
+			// The mipmaps came with it, nothing to generate
+			ResidentTexture resident;
+			resident.id = texture.id;
+			resident.bytes = data.getTotalSize();
+			resident.lastUsed = frameNumber;
+			textureTable.publish(texture.handle, resident);
+			residentTextures.push_back(texture.handle);
+			residentTextureBytes += resident.bytes;
 			{
-				std::lock_guard lock(loadingTextures_mutex);
-				countLoaded = loadedTextures.count(filename);
+				std::lock_guard lock(requestedTextures_mutex);
+				auto record = textureRecords.find(texture.handle);
+				if (record != textureRecords.end()) {
+					record->second.bytes = resident.bytes;
+					mtopengl::addResource(mtopengl::ResourceType::Texture, (record->second.refs > 0) ? record->second.owner : mtopengl::getTextureCacheOwner(), resident.bytes);
+				}
 			}
-			using namespace std::chrono_literals;
-			std::this_thread::sleep_for(1ms);
+			pendingTextures.pop_front();
+			completed++;
 		}
-		dout.verbose("OpenGL --> Got the texture");
-	}
 
-	// It is loaded, set the return value and return
-	{
-		std::lock_guard lock(loadingTextures_mutex);
-		textId = loadedTextures[filename].id;
+		float elapsedMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (elapsedMs >= budgetMs)
+			break;
 	}
 
-	// Do a check on the return value
-	if (textId == 0) {
-		// NULL!
-		dout.error("getTexture() is about to return a null pointer for texture filename \"" + filename + "\"");
-	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
 
-	return textId;
+	profiler::addCounterToCurrentFrame("mtopengl::textureUploadBytes", uploadedBytes);
+	profiler::addCounterToCurrentFrame("mtopengl::texturesCompleted", completed);
+	profiler::addCounterToCurrentFrame("mtopengl::texturesPending", pendingTextures.size());
 }
 
-void mtopengl::processTextureLoadRequests() {
-	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::mtopengl::processTextureLoadRequests()");
-	// Acquire the locks for the duration of the processing
-	std::lock_guard lock(loadingTextures_mutex);
+static void cleanupTextures() {
+	for (PendingTexture& texture : pendingTextures) {
+		if (texture.id != 0)
+			glDeleteTextures(1, &texture.id);
+	}
+	pendingTextures.clear();
+	for (TextureHandle handle : residentTextures) {
+		ResidentTexture* resident = textureTable.get(handle);
+		if (resident != NULL)
+			glDeleteTextures(1, &resident->id);
+	}
+	residentTextures.clear();
+	residentTextureBytes = 0;
+	pixelStream.cleanup();
+	if (placeholderTexture != 0) {
+		glDeleteTextures(1, &placeholderTexture);
+		placeholderTexture = 0;
+	}
+}
 
-	for (auto const& e : texturesToLoad) {
-		mtopengl::TextureDef def = e;
-		// Do the load
-		def.id = textureFromFile(def.filename, def.gamma);
-		// Put the def in the loadedTextures map
-		loadedTextures[def.filename] = def;
+// Deletes the least recently drawn textures nobody holds a reference to until we are back under budget. Referenced textures are
+// never evicted, however far over budget they take us
+static void evictTextures() {
+	profiler::addCounterToCurrentFrame("mtopengl::textureBytes", residentTextureBytes);
+
+	size_t budget = textureBudgetBytes.load();
+	if (residentTextureBytes <= budget)
+		return;
+	profiler::ScopeProfiler profiler("MultiThreadedOpenGL.cpp::evictTextures()");
+
+	std::sort(residentTextures.begin(), residentTextures.end(), [](TextureHandle a, TextureHandle b) {
+		return textureTable.get(a)->lastUsed < textureTable.get(b)->lastUsed;
+	});
+
+	int evicted = 0;
+	// Held throughout, so nobody can pick up a reference to a texture while we are deleting it
+	std::lock_guard lock(requestedTextures_mutex);
+	for (auto it = residentTextures.begin(); it != residentTextures.end() && residentTextureBytes > budget;) {
+		auto record = textureRecords.find(*it);
+		if (record != textureRecords.end() && record->second.refs > 0) {
+			it++;
+			continue;
+		}
+
+		ResidentTexture* resident = textureTable.get(*it);
+		glDeleteTextures(1, &resident->id);
+		residentTextureBytes -= resident->bytes;
+		if (record != textureRecords.end()) {
+			mtopengl::removeResource(mtopengl::ResourceType::Texture, mtopengl::getTextureCacheOwner(), record->second.bytes);
+			requestedTextures.erase(record->second.key);
+			textureRecords.erase(record);
+		}
+		textureTable.release(*it);
+		it = residentTextures.erase(it);
+		evicted++;
 	}
 
-	// clear the toLoad pile
-	texturesToLoad.clear();
+	profiler::addCounterToCurrentFrame("mtopengl::texturesEvicted", evicted);
 }
 
-unsigned int mtopengl::textureFromFile(const string filename, bool gamma) {
+void mtopengl::retainTexture(TextureHandle handle) {
+	if (handle == 0)
+		return;
+	std::lock_guard lock(requestedTextures_mutex);
+	auto record = textureRecords.find(handle);
+	if (record != textureRecords.end())
+		record->second.refs++;
+}
 
-	unsigned int textureID = 0;
+void mtopengl::releaseTexture(TextureHandle handle) {
+	if (handle == 0)
+		return;
+	std::lock_guard lock(requestedTextures_mutex);
+	auto record = textureRecords.find(handle);
+	if (record == textureRecords.end() || --record->second.refs > 0)
+		return;
 
-	if (!std::filesystem::exists(filename)) {
-		dout.error("Could not load texture: does not exist! (" + filename + ")");
-		return textureID;
+	if (record->second.failed) {
+		// Nothing to keep, and it is already out of requestedTextures
+		textureRecords.erase(record);
+		textureTable.release(handle);
+		return;
 	}
-	dout.log("textureFromFile('" + filename + "', '" + std::to_string(gamma) + "')");
 
-	glGenTextures(1, &textureID);
+	if (record->second.bytes > 0) {
+		mtopengl::removeResource(ResourceType::Texture, record->second.owner, record->second.bytes);
+		mtopengl::addResource(ResourceType::Texture, mtopengl::getTextureCacheOwner(), record->second.bytes);
+	}
 
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data) {
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
+	if (headless) {
+		// There is nothing on a GPU to keep around
+		requestedTextures.erase(record->second.key);
+		textureRecords.erase(record);
+		textureTable.release(handle);
 	}
-	else {
-		dout.error("Texture failed to load at path: " + filename);
-		stbi_image_free(data);
+	// Otherwise it stays resident until the budget needs the room, so the next scene to ask for it gets it straight away
+}
+
+void mtopengl::retainTextures(const std::vector<TextureHandle>& handles) {
+	std::lock_guard lock(requestedTextures_mutex);
+	for (TextureHandle handle : handles) {
+		auto record = textureRecords.find(handle);
+		if (record != textureRecords.end())
+			record->second.refs++;
 	}
+}
 
-	return textureID;
-}
\ No newline at end of file
+void mtopengl::releaseTextures(const std::vector<TextureHandle>& handles) {
+	for (TextureHandle handle : handles) {
+		releaseTexture(handle);
+	}
+}
+
+void mtopengl::setTextureBudget(size_t bytes) {
+	textureBudgetBytes = bytes;
+}
+
+void mtopengl::setTextureUploadBudget(size_t bytes, float milliseconds) {
+	uploadBudgetBytes = std::max(bytes, (size_t)1);
+	uploadBudgetMs = milliseconds;
+}
+
+bool mtopengl::isTextureReady(TextureHandle handle) {
+	return textureTable.isReady(handle);
+}
+
+bool mtopengl::hasTextureFailed(TextureHandle handle) {
+	std::lock_guard lock(requestedTextures_mutex);
+	auto record = textureRecords.find(handle);
+	return record != textureRecords.end() && record->second.failed;
+}
+
+unsigned int mtopengl::getTextureId(TextureHandle handle) {
+	ResidentTexture* resident = textureTable.get(handle);
+	if (resident == NULL)
+		return placeholderTexture;
+	resident->lastUsed = frameNumber;
+	return resident->id;
+}
@@ -19,71 +19,148 @@ THREADING IN OPERATION, might be safe
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <filesystem>
 #include <chrono>
+#include <atomic>
+#include <deque>
+#include <algorithm>
 #include "stb_image.hpp"
 
 #include "Log.hpp"
 #include "DarkSunProfiler.hpp"
 #include "OpenGLStructs.hpp"
+#include "SPSCQueue.hpp"
+#include "SlotMap.hpp"
+#include "StreamingBuffer.hpp"
+#include "CompletionQueue.hpp"
+#include "GeometryPool.hpp"
+#include "VertexFormats.hpp"
+#include "ResourceInventory.hpp"
+#include "CommandBuffer.hpp"
+#include "AssetManager.hpp"
+#include "TextureCache.hpp"
 
 using string = std::string;
 
 namespace darksun::mtopengl {
 
-	// Stores loading information for a Texture struct and texture binding
-	struct TextureDef {
-		unsigned int id = 0;
-		string filename = "";
-		bool gamma = false;
-	};
-
-	// Stores the information about a VAO
+	// Stores the information about a VAO. Meshes in a geometry pool page share its VAO, VBO and EBO and are drawn from their
+	// base vertex and first index, anything too big for the pool has buffers of its own and starts at 0
 	struct VAODef {
+		VertexFormat format = VertexFormat::Full;
 		unsigned int VAO = 0;
-		unsigned int VBO = 0; unsigned int VBOSize = 0;
+		unsigned int VBO = 0; unsigned int VBOSize = 0; // Size of this mesh's vertices, not the whole buffer
 		unsigned int EBO = 0; unsigned int EBOSize = 0;
-		int ref = 0;
-
-		std::vector<Vertex> vertices = std::vector<Vertex>();
-		std::vector<unsigned int> indices = std::vector<unsigned int>();
+		unsigned int baseVertex = 0;
+		unsigned int firstIndex = 0;
+		unsigned int numIndices = 0;
+		unsigned int indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT for meshes with few enough vertices
+		int page = -1; // Geometry pool page, -1 if it has its own buffers
 	};
 
-	// Contains information to update a VAO buffer: verticies (VBO)
-	struct VBOUpdateDef {
-		int vaoDefRef = 0;
+	// Generational handle into the VAO table, see SlotMap.hpp
+	typedef SlotHandle VAOHandle;
+
+	// Accessed by the OpenGL thread only, replays the commands recorded since the last call most important class first, until
+	// the command budget is spent. Anything left over is replayed first next frame
+	void process();
+
+	// Sets how much command data the OpenGL thread replays per frame, it stops at whichever runs out first. Any thread
+	void setCommandBudget(size_t bytes, float milliseconds);
 
-		std::vector<Vertex> vertices = std::vector<Vertex>();
+	// Class of anything requested from here on by this thread, until the scope closes. VBO updates and releases follow the class
+	// their VAO was requested in
+	class PriorityScope {
+
+	public:
+		PriorityScope(CommandPriority priority);
+		~PriorityScope();
+
+		PriorityScope(const PriorityScope&) = delete;
+		PriorityScope& operator=(const PriorityScope&) = delete;
+
+	private:
+		CommandPriority previous;
 	};
 
-	// Accessed by the OpenGL thread only
-	void process();
+	// The class anything requested on this thread right now is replayed in, Visible unless a scope says otherwise
+	CommandPriority getCurrentPriority();
+
+	// With no OpenGL thread, requests resolve straight away with null ids and nothing is recorded. Set before any requests are made
+	void setHeadless(bool h);
+	bool isHeadless();
 
-	// Accessed by functions that want to get a textre from the multi-threading solution
-	unsigned int getTexture(const string filename, bool gamma);
+	// Accessed by functions that want a texture from the multi-threading solution. Returns straight away with a handle that becomes
+	// ready once the texture has been decoded on the workers and streamed in by the OpenGL thread, requests for a file already
+	// requested share the same handle. Each request holds a reference to the texture until releaseTexture() is called
+	TextureHandle requestTexture(const string filename, bool gamma);
 
-	// Accessed by the opengl thread ONLY
-	unsigned int textureFromFile(const string filename, bool gamma);
+	// Adds and drops a reference to a texture. Any thread. A texture nobody references stays on the GPU until it is evicted to stay
+	// within the texture budget, least recently drawn first
+	void retainTexture(TextureHandle handle);
+	void releaseTexture(TextureHandle handle);
+	// The same for a batch of handles, retaining takes the lock once
+	void retainTextures(const std::vector<TextureHandle>& handles);
+	void releaseTextures(const std::vector<TextureHandle>& handles);
 
-	// Accessed by the opengl thread ONLY
-	void processTextureLoadRequests();
+	// Sets how much memory textures may take before unreferenced ones are evicted. Any thread
+	void setTextureBudget(size_t bytes);
 
-	// Accessed by functions that want to get a VAO from the multi-threading solution
-	mtopengl::VAODef getVAO(std::vector<Vertex>* vertices, std::vector<unsigned int>* indices);
+	// Returns true once the OpenGL thread has streamed the whole texture in. Any thread
+	bool isTextureReady(TextureHandle handle);
 
-	// Accessed by the opengl thread ONLY
-	void processVAOLoadRequests();
+	// Returns true if the texture couldn't be read, decoded or uploaded. It is drawn with the placeholder for good, and the next
+	// request for the file tries again. Any thread
+	bool hasTextureFailed(TextureHandle handle);
 
-	// Accessed by main thread functions that want to update their VAO VBO data
-	void updateVBO(int vaoRef, std::vector<Vertex>* vertices);
+	// Returns the GL id of the texture, or of the placeholder if it isn't ready or the handle is stale. Accessed by the opengl thread ONLY
+	unsigned int getTextureId(TextureHandle handle);
 
-	// Accesed by the opengl thread ONLY
-	void processVBOUpdateRequests();
+	// Sets how much texture data the OpenGL thread streams in per frame, it stops at whichever runs out first. Any thread
+	void setTextureUploadBudget(size_t bytes, float milliseconds);
 
-	// Accessed by the main thread to intercept events
-	std::vector<sf::Event> getEvents();
+	// Accessed by functions that want a VAO from the multi-threading solution. Packs the vertices into the format and returns straight
+	// away with a handle that becomes ready once the OpenGL thread has created it. The caller holds the only reference to it
+	mtopengl::VAOHandle requestVAO(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, VertexFormat format = VertexFormat::Full);
 
-	// Accessed by the opengl thread to push events
+	// Adds and drops a reference to a VAO. Any thread. Dropping the last one deletes the VAO and its buffers on the OpenGL thread
+	void retainVAO(VAOHandle handle);
+	void releaseVAO(VAOHandle handle);
+	// The same for a batch of handles, retaining takes the lock once
+	void retainVAOs(const std::vector<VAOHandle>& handles);
+	void releaseVAOs(const std::vector<VAOHandle>& handles);
+
+	// Returns true once the OpenGL thread has created the VAO. Any thread
+	bool isVAOReady(VAOHandle handle);
+
+	// Returns the VAO definition, NULL if it isn't ready or the handle is stale. Accessed by the opengl thread ONLY
+	const VAODef* getVAO(VAOHandle handle);
+
+	// Accessed by main thread functions that want to update their VAO VBO data. Packs count vertices into the VAO's format, they
+	// replace the vertices from firstVertex onwards in the VBO
+	void updateVBO(VAOHandle vao, const Vertex* vertices, unsigned int firstVertex, unsigned int count);
+
+	// Accessed by the opengl thread ONLY. Runs the callback at the start of the first process() after the GPU has finished every
+	// upload issued so far, for recycling memory the uploads read from without waiting on the GPU
+	void whenUploadsComplete(std::function<void()> callback);
+
+	// Accessed by the opengl thread ONLY, frees what the OpenGL thread owns before the context goes
+	void cleanup();
+
+	// Accessed by the main thread to intercept events. Moves up to max queued events into buffer and returns how many were moved
+	int getEvents(sf::Event* buffer, int max);
+
+	// Accessed by the opengl thread to push events. Consecutive mouse moves are coalesced, so only the last one is kept
 	void addEvent(sf::Event e);
 
+	// Accessed by the opengl thread after each batch of events, pushes any mouse move still being held back for coalescing
+	void flushEvents();
+
+	// Returns the number of events dropped because the queue was full
+	unsigned long long getDroppedEventCount();
+
+	// Returns the number of mouse move events merged into a later one
+	unsigned long long getCoalescedEventCount();
+
 }
\ No newline at end of file
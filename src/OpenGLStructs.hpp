@@ -10,6 +10,10 @@ Basic opengl structs/defs etc
 
 #include <glm/glm.hpp>
 #include <string>
+#include <memory>
+#include <atomic>
+
+#include "SlotMap.hpp"
 
 using string = std::string;
 
@@ -23,10 +27,20 @@ namespace darksun {
 		glm::vec3 Bitangent;
 	};
 
+	// How a mesh's vertices are laid out on the GPU, see VertexFormats.hpp. Meshes always keep full Vertex data on the CPU
+	enum class VertexFormat : unsigned char {
+		Full = 0,	// Everything in Vertex, for meshes with normal maps
+		Standard,	// Position, packed normal and texture coordinates
+		Terrain,	// Position, packed normal and half float texture coordinates
+		COUNT
+	};
+
+	// Generational handle into the texture table, the GL id is looked up with mtopengl::getTextureId() on the OpenGL thread
+	typedef SlotHandle TextureHandle;
+
 	struct Texture {
-		unsigned int id;
 		string type;
-		string path;
+		TextureHandle handle = 0;
 	};
 
 }
@@ -0,0 +1,136 @@
+/**
+
+File: RenderQueue.cpp
+Description:
+
+Orders a frame's draws by the GL state they need
+
+Rendering thread ONLY
+
+*/
+
+#include "RenderQueue.hpp"
+
+using namespace darksun;
+
+unsigned int RenderQueue::quantizeDepth(float depth, float maxDepth) {
+	if (maxDepth <= 0.0f || depth <= 0.0f)
+		return 0;
+	const unsigned int maxValue = (1u << DEPTH_BITS) - 1;
+	float scaled = depth / maxDepth * (float)maxValue;
+	return (scaled >= (float)maxValue) ? maxValue : (unsigned int)scaled;
+}
+
+void RenderQueue::clear() {
+	commands.clear();
+	materials.clear();
+	materialsByHash.clear();
+	vaos.clear();
+	for (int p = 0; p <= (int)RenderPass::COUNT; p++)
+		passStart[p] = 0;
+
+	// Draws without textures all share the empty material
+	materials.push_back(RenderMaterial());
+}
+
+uint64_t RenderQueue::hashMaterial(const RenderMaterial& material) {
+	// FNV-1a over the uniforms and textures
+	uint64_t hash = 14695981039346656037ull;
+	for (int i = 0; i < material.count; i++) {
+		hash = (hash ^ material.uniforms[i]) * 1099511628211ull;
+		hash = (hash ^ material.textures[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+bool RenderQueue::sameMaterial(const RenderMaterial& a, const RenderMaterial& b) {
+	if (a.count != b.count)
+		return false;
+	for (int i = 0; i < a.count; i++) {
+		if (a.uniforms[i] != b.uniforms[i] || a.textures[i] != b.textures[i])
+			return false;
+	}
+	return true;
+}
+
+unsigned int RenderQueue::addMaterial(const RenderMaterial& material) {
+	if (material.count == 0)
+		return NO_MATERIAL;
+
+	uint64_t hash = hashMaterial(material);
+	auto it = materialsByHash.find(hash);
+	if (it != materialsByHash.end() && sameMaterial(materials[it->second], material))
+		return it->second;
+
+	// On the off chance two sets hash the same the second just isn't shared, that only costs binds
+	unsigned int id = (unsigned int)materials.size();
+	materials.push_back(material);
+	if (it == materialsByHash.end())
+		materialsByHash[hash] = id;
+	return id;
+}
+
+unsigned int RenderQueue::getVAOId(unsigned int vao) {
+	auto it = vaos.find(vao);
+	if (it != vaos.end())
+		return it->second;
+	unsigned int id = (unsigned int)vaos.size();
+	vaos[vao] = id;
+	return id;
+}
+
+void RenderQueue::add(uint64_t key, uint32_t item, uint32_t material) {
+	RenderCommand command;
+	command.key = key;
+	command.item = item;
+	command.material = material;
+	commands.push_back(command);
+}
+
+void RenderQueue::sort() {
+	profiler::ScopeProfiler sortProfiler("RenderQueue.cpp::RenderQueue::sort()");
+
+	size_t n = commands.size();
+	if (n > 1) {
+		// LSD radix sort a byte at a time. Keeps the order of equal keys, and bytes every key shares (the top of the material and
+		// VAO ids mostly) are skipped without moving anything
+		scratch.resize(n);
+		RenderCommand* from = commands.data();
+		RenderCommand* to = scratch.data();
+		int passes = 0;
+		for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+			size_t counts[RADIX_SIZE] = {};
+			for (size_t i = 0; i < n; i++)
+				counts[(from[i].key >> shift) & (RADIX_SIZE - 1)]++;
+			if (counts[(from[0].key >> shift) & (RADIX_SIZE - 1)] == n)
+				continue;
+
+			size_t offset = 0;
+			for (int d = 0; d < RADIX_SIZE; d++) {
+				size_t count = counts[d];
+				counts[d] = offset;
+				offset += count;
+			}
+			for (size_t i = 0; i < n; i++)
+				to[counts[(from[i].key >> shift) & (RADIX_SIZE - 1)]++] = from[i];
+			std::swap(from, to);
+			passes++;
+		}
+		// An odd number of passes leaves the result in the scratch array
+		if (from != commands.data())
+			commands.swap(scratch);
+		profiler::addCounterToCurrentFrame("RenderQueue::sortPasses", passes);
+	}
+
+	// Passes are the top bits, so each is one run of the sorted array
+	size_t c = 0;
+	for (int p = 0; p < (int)RenderPass::COUNT; p++) {
+		passStart[p] = c;
+		while (c < n && (commands[c].key >> PASS_SHIFT) == (uint64_t)p)
+			c++;
+	}
+	passStart[(int)RenderPass::COUNT] = n;
+
+	profiler::addCounterToCurrentFrame("RenderQueue::commands", (long long)n);
+	profiler::addCounterToCurrentFrame("RenderQueue::materials", (long long)materials.size() - 1);
+}
@@ -0,0 +1,120 @@
+#pragma once
+/**
+
+File: RenderQueue.hpp
+Description:
+
+Orders a frame's draws by the GL state they need rather than by renderable name. Every draw goes in a flat array with a 64 bit
+key, most significant first: pass, shader, material (the set of textures bound for it), VAO, then depth. The array is radix
+sorted once a frame, so draws needing the same state end up next to each other and the renderer only changes state between
+them when the key says it has to.
+
+Materials and VAOs are given small ids in the order they are first seen each frame, so the key only has to group them, the
+order of the groups doesn't matter. Depth is last, draws with the same state go front to back.
+
+Rendering thread ONLY
+
+*/
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+#include "Shader.hpp"
+
+namespace darksun {
+
+	enum class RenderPass : unsigned char {
+		Shadow = 0,
+		Main,
+		COUNT
+	};
+
+	// One draw, item is its index in the frame packet's draw items. The material id is kept in full as well as in the key, the
+	// key only has room for its low bits and it fits in what would otherwise be padding
+	struct RenderCommand {
+		uint64_t key = 0;
+		uint32_t item = 0;
+		uint32_t material = 0;
+	};
+
+	// The textures bound for a draw and the sampler uniform of each, texture i goes on unit i
+	struct RenderMaterial {
+		const static int MAX_TEXTURES = 9;
+		int count = 0;
+		UniformId uniforms[MAX_TEXTURES];
+		unsigned int textures[MAX_TEXTURES];
+	};
+
+	class RenderQueue {
+
+	public:
+		RenderQueue() { clear(); }
+
+		// Key layout, from the most significant bit down
+		const static int PASS_BITS = 2;
+		const static int SHADER_BITS = 6;
+		const static int MATERIAL_BITS = 24;
+		const static int VAO_BITS = 16;
+		const static int DEPTH_BITS = 16;
+
+		const static int DEPTH_SHIFT = 0;
+		const static int VAO_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+		const static int MATERIAL_SHIFT = VAO_SHIFT + VAO_BITS;
+		const static int SHADER_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+		const static int PASS_SHIFT = SHADER_SHIFT + SHADER_BITS;
+
+		// Material id of draws that bind no textures
+		const static unsigned int NO_MATERIAL = 0;
+
+		static uint64_t makeKey(RenderPass pass, unsigned int shader, unsigned int material, unsigned int vao, unsigned int depth) {
+			return ((uint64_t)pass << PASS_SHIFT) | (field(shader, SHADER_BITS) << SHADER_SHIFT) | (field(material, MATERIAL_BITS) << MATERIAL_SHIFT) |
+				(field(vao, VAO_BITS) << VAO_SHIFT) | (field(depth, DEPTH_BITS) << DEPTH_SHIFT);
+		}
+
+		// Maps a distance in [0, maxDepth] onto the depth field, anything further is clamped
+		static unsigned int quantizeDepth(float depth, float maxDepth);
+
+		// Empties the queue and forgets this frame's materials and VAOs, keeping the memory for the next frame
+		void clear();
+
+		// Returns the material id of the texture set, the same textures with the same uniforms get the same id until clear()
+		unsigned int addMaterial(const RenderMaterial& material);
+		const RenderMaterial& getMaterialById(unsigned int id) { return materials[id]; }
+
+		// Returns the id of the GL VAO until clear()
+		unsigned int getVAOId(unsigned int vao);
+
+		void add(uint64_t key, uint32_t item, uint32_t material);
+
+		// Radix sorts the commands by key, and finds where each pass starts
+		void sort();
+
+		// The sorted commands of one pass, only valid after sort()
+		const RenderCommand* begin(RenderPass pass) { return commands.data() + passStart[(int)pass]; }
+		const RenderCommand* end(RenderPass pass) { return commands.data() + passStart[(int)pass + 1]; }
+
+		int size() { return (int)commands.size(); }
+
+	private:
+		const static int RADIX_BITS = 8;
+		const static int RADIX_SIZE = 1 << RADIX_BITS;
+
+		std::vector<RenderCommand> commands;
+		std::vector<RenderCommand> scratch;
+		size_t passStart[(int)RenderPass::COUNT + 1] = {};
+
+		// Index 0 is NO_MATERIAL
+		std::vector<RenderMaterial> materials;
+		std::unordered_map<uint64_t, unsigned int> materialsByHash;
+		std::unordered_map<unsigned int, unsigned int> vaos;
+
+		static uint64_t field(uint64_t value, int bits) { return value & ((1ull << bits) - 1); }
+		static uint64_t hashMaterial(const RenderMaterial& material);
+		static bool sameMaterial(const RenderMaterial& a, const RenderMaterial& b);
+	};
+
+}
@@ -20,6 +20,9 @@ Renderable::Renderable() {
 void Renderable::addMesh(Mesh m) {
 	std::lock_guard<std::mutex> lock(meshesMutex);
 	meshes.push_back(m);
+	// The new mesh has to resolve before we can be drawn
+	if (!m.isResolved())
+		meshesResolved = false;
 }
 
 //std::vector<Mesh> Renderable::getMeshes() {
@@ -71,4 +74,11 @@ void Renderable::setScale(float s) {
 void Renderable::setScale(glm::vec3 n) {
 	profiler::ScopeProfiler myProfiler("Renderable.cpp::Renderable::setScale()");
 	scale.store(n);
+}
+
+void Renderable::storePreviousTransform() {
+	previousPosition.store(position.load());
+	previousRotation.store(rotation.load());
+	previousScale.store(scale.load());
+	hasPreviousTransform.store(true);
 }
\ No newline at end of file
@@ -16,6 +16,8 @@ Thread safed
 #include <atomic>
 #include <mutex>
 
+#include <glm/gtc/matrix_transform.hpp>
+
 #include "DarkSunProfiler.hpp"
 
 using namespace darksun;
@@ -30,11 +32,18 @@ namespace darksun {
 
 		std::atomic<bool> gammaCorrection = false;
 		std::atomic<bool> loaded = false;
+		std::atomic<bool> meshesResolved = false; // Set once the GPU resources for every mesh exist
 
 		std::atomic <glm::vec3> position = glm::vec3(0.0f, 0.0f, 0.0f);
 		std::atomic <glm::vec3> rotation = glm::vec3(0.0f, 0.0f, 0.0f);
 		std::atomic <glm::vec3> scale = glm::vec3(1.0f, 1.0f, 1.0f);
 
+		// Transform at the start of the current simulation tick, used to interpolate between sim states when rendering
+		std::atomic<bool> hasPreviousTransform = false;
+		std::atomic <glm::vec3> previousPosition = glm::vec3(0.0f, 0.0f, 0.0f);
+		std::atomic <glm::vec3> previousRotation = glm::vec3(0.0f, 0.0f, 0.0f);
+		std::atomic <glm::vec3> previousScale = glm::vec3(1.0f, 1.0f, 1.0f);
+
 	public:
 
 		// Constructor
@@ -46,10 +55,14 @@ namespace darksun {
 		// Tick function
 		void tick(float deltaTime) {
 			std::lock_guard lock(meshesMutex);
-			// Allow the meshes to update
+			// Allow the meshes to update, and pick up any GPU resources that have finished being created
+			bool allResolved = true;
 			for (auto& e : meshes) {
+				if (!e.resolve())
+					allResolved = false;
 				e.tick(deltaTime);
 			}
+			meshesResolved = allResolved;
 		}
 
 		// Get the position
@@ -79,8 +92,18 @@ namespace darksun {
 		// Set the gamma correction
 		void setGammaCorrection(bool g) { profiler::ScopeProfiler myProfiler("Renderable.hpp::Renderable::setGammaCorrection()"); gammaCorrection.store(g); }
 
+		// Stores the current transform as the previous simulation state, called at the start of each fixed simulation tick
+		void storePreviousTransform();
+		// Returns if a previous simulation state has been stored
+		bool getHasPreviousTransform() { return hasPreviousTransform.load(); }
+		// Get the previous simulation state
+		glm::vec3 getPreviousPosition() { return previousPosition.load(); }
+		glm::vec3 getPreviousRotation() { return previousRotation.load(); }
+		glm::vec3 getPreviousScale() { return previousScale.load(); }
+
+		// Returns if the renderable is loaded and every mesh is ready to draw
 		bool isLoaded() {
-			return loaded.load();
+			return loaded.load() && meshesResolved.load();
 		}
 		void setLoaded(bool l) {
 			loaded.store(l);
@@ -11,6 +11,36 @@ A class that handles a window and the rendering to and from it
 
 using namespace darksun;
 
+// Uniforms set every frame, hashed at compile time
+static constexpr UniformId UNIFORM_MODEL = uniformId("model");
+static constexpr UniformId UNIFORM_VIEW = uniformId("view");
+static constexpr UniformId UNIFORM_PROJECTION = uniformId("projection");
+static constexpr UniformId UNIFORM_LIGHT_SPACE_MATRIX = uniformId("lightSpaceMatrix");
+static constexpr UniformId UNIFORM_SHADOW_MAP = uniformId("shadowMap");
+static constexpr UniformId UNIFORM_OBJECT_COLOR = uniformId("objectColor");
+static constexpr UniformId UNIFORM_VIEW_POS = uniformId("viewPos");
+static constexpr UniformId UNIFORM_LIGHT_POSITIONS = uniformId("lightPositions");
+static constexpr UniformId UNIFORM_LIGHT_COLORS = uniformId("lightColors");
+static constexpr UniformId UNIFORM_LIGHT_ATTENUATES = uniformId("lightAttenuates");
+
+// Index of each shader in the render queue keys
+static const unsigned int SHADER_DEFAULT = 0;
+static const unsigned int SHADER_SHADOW = 1;
+
+// Mesh textures are bound to material.<type>N, N counting up from 1 for diffuse and specular textures
+static const int MAX_MESH_TEXTURES = RenderMaterial::MAX_TEXTURES;
+static constexpr UniformId UNIFORM_MATERIAL = uniformId("material.");
+
+static std::array<UniformId, MAX_MESH_TEXTURES + 1> materialUniformIds(const char* type) {
+	std::array<UniformId, MAX_MESH_TEXTURES + 1> ids;
+	for (int n = 1; n <= MAX_MESH_TEXTURES; n++) {
+		ids[n] = uniformId(std::to_string(n).c_str(), uniformId(type, UNIFORM_MATERIAL));
+	}
+	return ids;
+}
+static const std::array<UniformId, MAX_MESH_TEXTURES + 1> UNIFORM_DIFFUSE_TEXTURES = materialUniformIds("texture_diffuse");
+static const std::array<UniformId, MAX_MESH_TEXTURES + 1> UNIFORM_SPECULAR_TEXTURES = materialUniformIds("texture_specular");
+
 void Renderer::createWindow(sf::ContextSettings& settings) {
 	defaultWindow.create(sf::VideoMode(SCREEN_WIDTH, SCREEN_HEIGHT), "DarkSun", sf::Style::Default, settings);
 }
@@ -33,6 +63,7 @@ void Renderer::create(ApplicationSettings* settings) {
 	glewInit();
 
 	catchOpenGLErrors("GLEW_INIT");
+	profiler::markStartupPhase("window/GLEW");
 
 	// Do state init for opengl
 	glEnable(GL_DEPTH_TEST);
@@ -60,11 +91,13 @@ void Renderer::create(ApplicationSettings* settings) {
 
 	// Init the shaders
 	initShaders();
+	profiler::markStartupPhase("shaders");
 
 	// Create the shadow stuffs
 	initShadows();
 
 	catchOpenGLErrors("SHADOWS setup");
+	profiler::markStartupPhase("shadow FBO");
 
 	// Create camera
 	{
@@ -80,6 +113,19 @@ void Renderer::create(ApplicationSettings* settings) {
 	dout.log("glewTest: " + std::to_string(vertexBuffer));
 }
 
+void Renderer::createHeadless(ApplicationSettings* settings) {
+	appSettings = settings;
+	headless = true;
+
+	// The scene still moves the camera and reads from it
+	{
+		std::lock_guard lock(camera_mutex);
+		camera = std::shared_ptr<Camera>(new Camera());
+	}
+
+	dout.log("Renderer --> Created headless, no window or OpenGL context");
+}
+
 void Renderer::initShadows() {
 	// configure depth map FBO
 	// -----------------------
@@ -113,7 +159,7 @@ void Renderer::initShaders() {
 	defaultShader = std::shared_ptr<Shader>(new Shader("core/shader/lighting_vertex.shader", "core/shader/lighting_geometry.shader", "core/shader/lighting_fragment.shader"));
 	defaultShader->use();
 	catchOpenGLErrors("defaultShader setup");
-	defaultShader->setInt("shadowMap", 10);
+	defaultShader->setInt(UNIFORM_SHADOW_MAP, 10);
 	catchOpenGLErrors("shadowMap setup");
 
 	// Create the shadow shader for directional lights
@@ -133,24 +179,131 @@ void Renderer::clearscreen() {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
-void Renderer::prepLights(std::shared_ptr<Shader> shader) {
-	shader->setVec3("objectColor", 1.0f, 1.0f, 1.0f);
+void Renderer::prepLights(std::shared_ptr<Shader> shader, FramePacket* packet, glm::vec3 viewPos) {
+	shader->setVec3(UNIFORM_OBJECT_COLOR, 1.0f, 1.0f, 1.0f);
 	// set light uniforms
-	{
-		std::scoped_lock lock(lightPositions_mutex, lightColors_mutex, lightAttenuates_mutex);
-		glUniform3fv(glGetUniformLocation(shader->ID, "lightPositions"), NUMBER_OF_LIGHTS, &lightPositions[0][0]);
-		glUniform3fv(glGetUniformLocation(shader->ID, "lightColors"), NUMBER_OF_LIGHTS, &lightColors[0][0]);
-		glUniform1iv(glGetUniformLocation(shader->ID, "lightAttenuates"), NUMBER_OF_LIGHTS, &lightAttenuates[0]);
-
-	}
-	shader->setVec3("viewPos", camera->getPosition());
+	shader->setVec3Array(UNIFORM_LIGHT_POSITIONS, NUMBER_OF_LIGHTS, &packet->lightPositions[0]);
+	shader->setVec3Array(UNIFORM_LIGHT_COLORS, NUMBER_OF_LIGHTS, &packet->lightColors[0]);
+	shader->setIntArray(UNIFORM_LIGHT_ATTENUATES, NUMBER_OF_LIGHTS, &packet->lightAttenuates[0]);
+	shader->setVec3(UNIFORM_VIEW_POS, viewPos);
 }
 
 void Renderer::setGammaCorrection(bool g) {
 	gammaCorrection = g;
 }
 
-void Renderer::catchOpenGLErrors(string ref) {
+void Renderer::storePreviousTransforms() {
+	std::lock_guard lock(renderables_mutex);
+	for (auto const& r : renderables) {
+		r.second->storePreviousTransform();
+	}
+}
+
+void Renderer::markSimulationTick(float step) {
+	lastSimulationTick = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	simulationStep = step;
+	interpolationEnabled = true;
+}
+
+float Renderer::getInterpolationAlpha(FramePacket* packet) {
+	if (!packet->interpolate || packet->simulationStep <= 0.0f) {
+		return 1.0f;
+	}
+	long long now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	float sinceTick = (float)(now - packet->simulationTick) / 1000000000.0f;
+	return glm::clamp(sinceTick / packet->simulationStep, 0.0f, 1.0f);
+}
+
+void Renderer::publishFrame() {
+	profiler::ScopeProfiler publishProfiler("Renderer.cpp::Renderer::publishFrame()");
+
+	FramePacket* packet = framePackets.getBack();
+	// Drops the references held by the last packet in this slot, so anything unregistered since is released on this thread
+	packet->clear();
+	packet->frameNumber = ++framesPublished;
+
+	{
+		std::lock_guard lock(renderables_mutex);
+		for (auto const& r : renderables) {
+			if (!r.second->isLoaded()) {
+				// This renderable isn't ready to be drawn, skip
+				continue;
+			}
+
+			// Read each transform once here, so the rendering thread never sees one half way through an update
+			FrameTransform t;
+			t.position = r.second->getPosition();
+			t.rotation = r.second->getRotation();
+			t.scale = r.second->getScale();
+			t.hasPrevious = r.second->getHasPreviousTransform();
+			if (t.hasPrevious) {
+				t.previousPosition = r.second->getPreviousPosition();
+				t.previousRotation = r.second->getPreviousRotation();
+				t.previousScale = r.second->getPreviousScale();
+			}
+
+			int transformIndex = (int)packet->transforms.size();
+			packet->transforms.push_back(t);
+
+			// Copy out what each mesh draws with, the packet never points into the renderable
+			int numMeshes = r.second->getNumberOfMeshes();
+			for (int i = 0; i < numMeshes; i++) {
+				Mesh& mesh = r.second->getMeshAt(i);
+				FrameDrawItem item;
+				item.vao = mesh.getVAO();
+				item.transform = transformIndex;
+				item.firstTexture = (unsigned int)packet->textures.size();
+
+				// Work out the sampler each texture goes to, the N in material.texture_diffuseN
+				unsigned int diffuseNr = 1;
+				unsigned int specularNr = 1;
+				const std::vector<Texture>& textures = mesh.getTextures();
+				item.numTextures = (unsigned int)std::min((int)textures.size(), MAX_MESH_TEXTURES);
+				for (unsigned int t = 0; t < item.numTextures; t++) {
+					FrameTexture texture;
+					texture.handle = textures[t].handle;
+					const string& name = textures[t].type;
+					if (name == "texture_diffuse")
+						texture.uniform = UNIFORM_DIFFUSE_TEXTURES[diffuseNr++];
+					else if (name == "texture_specular")
+						texture.uniform = UNIFORM_SPECULAR_TEXTURES[specularNr++];
+					else
+						texture.uniform = uniformId(name.c_str(), UNIFORM_MATERIAL);
+					packet->textures.push_back(texture);
+				}
+				packet->drawItems.push_back(item);
+			}
+		}
+
+		// Taken while the renderables still hold theirs, so nothing can go between here and the packet being drawn
+		packet->retainResources();
+	}
+
+	{
+		std::lock_guard lock(renderableUIs_mutex);
+		for (auto const& e : renderableUIs) {
+			packet->uis.push_back(e.second);
+		}
+	}
+
+	{
+		std::scoped_lock lock(lightPositions_mutex, lightColors_mutex, lightAttenuates_mutex);
+		for (int i = 0; i < NUMBER_OF_LIGHTS; i++) {
+			packet->lightPositions[i] = lightPositions[i];
+			packet->lightColors[i] = lightColors[i];
+			packet->lightAttenuates[i] = lightAttenuates[i];
+		}
+	}
+	packet->gammaCorrection = gammaCorrection.load();
+
+	packet->interpolate = interpolationEnabled;
+	packet->simulationTick = lastSimulationTick;
+	packet->simulationStep = simulationStep;
+
+	framePackets.publish();
+}
+
+void Renderer::catchOpenGLErrors(const char* ref) {
 	// Catch our own GL errors, if for some reason we create them
 	GLenum error = glGetError();
 	if (error != GL_NO_ERROR) {
@@ -219,83 +372,178 @@ void Renderer::unregisterUI(string name) {
 	renderableUIs.erase(name);
 }
 
-void Renderer::drawUi() {
+void Renderer::drawUi(FramePacket* packet) {
 	profiler::ScopeProfiler drawProfiler("Renderer.cpp::Renderer::drawUi()");
 	defaultWindow.pushGLStates();
-	for (auto const& e : renderableUIs) {
-		e.second->draw();
+	for (auto const& e : packet->uis) {
+		e->draw();
 	}
 	defaultWindow.popGLStates();
 }
 
-void Renderer::draw(std::shared_ptr<Shader> shader) {
+// Interpolates between two angles in degrees, taking the shortest way around
+static float lerpAngle(float a, float b, float t) {
+	float diff = fmodf(b - a + 540.0f, 360.0f) - 180.0f;
+	return a + (diff * t);
+}
+
+// Builds the model matrix, interpolated between the previous and current simulation state (alpha = 1 is the current state)
+static glm::mat4 buildModelMatrix(const FrameTransform& t, float alpha) {
+	glm::vec3 pos = t.position;
+	glm::vec3 rot = t.rotation;
+	glm::vec3 scl = t.scale;
+
+	if (t.hasPrevious && alpha < 1.0f) {
+		pos = glm::mix(t.previousPosition, pos, alpha);
+		scl = glm::mix(t.previousScale, scl, alpha);
+		rot = glm::vec3(lerpAngle(t.previousRotation.x, rot.x, alpha), lerpAngle(t.previousRotation.y, rot.y, alpha), lerpAngle(t.previousRotation.z, rot.z, alpha));
+	}
+
+	glm::mat4 modelm = glm::mat4(1.0f);
+	modelm = glm::translate(modelm, pos);
+	modelm = glm::scale(modelm, scl);
+	modelm = glm::rotate(modelm, glm::radians(rot.x), glm::vec3(1.0f, 0.0f, 0.0f)); //X
+	modelm = glm::rotate(modelm, glm::radians(rot.y), glm::vec3(0.0f, 1.0f, 0.0f)); //Y
+	modelm = glm::rotate(modelm, glm::radians(rot.z), glm::vec3(0.0f, 0.0f, 1.0f)); //Z
+	return modelm;
+}
+
+void Renderer::queueDraws(FramePacket* packet, glm::vec3 cameraPosition, float farZ, glm::vec3 lightPosition, float lightFarZ) {
+	profiler::ScopeProfiler queueProfiler("Renderer.cpp::Renderer::queueDraws()");
+
+	renderQueue.clear();
+	for (uint32_t i = 0; i < (uint32_t)packet->drawItems.size(); i++) {
+		const FrameDrawItem& item = packet->drawItems[i];
+		const mtopengl::VAODef* def = mtopengl::getVAO(item.vao);
+		if (def == NULL)
+			continue;
+
+		RenderMaterial material;
+		material.count = (int)item.numTextures;
+		for (int t = 0; t < material.count; t++) {
+			const FrameTexture& texture = packet->textures[item.firstTexture + t];
+			material.uniforms[t] = texture.uniform;
+			material.textures[t] = mtopengl::getTextureId(texture.handle);
+		}
+		unsigned int materialId = renderQueue.addMaterial(material);
+		unsigned int vaoId = renderQueue.getVAOId(def->VAO);
+
+		const glm::vec4& translation = modelMatrices[item.transform][3];
+		glm::vec3 position = glm::vec3(translation.x, translation.y, translation.z);
+		// The shadow shader samples nothing, so shadow draws only group by VAO
+		renderQueue.add(RenderQueue::makeKey(RenderPass::Shadow, SHADER_SHADOW, RenderQueue::NO_MATERIAL, vaoId,
+			RenderQueue::quantizeDepth(glm::distance(position, lightPosition), lightFarZ)), i, RenderQueue::NO_MATERIAL);
+		renderQueue.add(RenderQueue::makeKey(RenderPass::Main, SHADER_DEFAULT, materialId, vaoId,
+			RenderQueue::quantizeDepth(glm::distance(position, cameraPosition), farZ)), i, materialId);
+	}
+	renderQueue.sort();
+}
+
+void Renderer::draw(std::shared_ptr<Shader> shader, RenderPass pass, FramePacket* packet) {
 	profiler::ScopeProfiler drawProfiler("Renderer.cpp::Renderer::draw()");
 
 	//dout.verbose("draw()");
-	
-	int numRenderables = renderables.size();
-	int numMeshes = 0;
-	for (auto const& r : renderables) {
-		if (!r.second->isLoaded()) {
-			// This renderable isn't ready to be drawn, skip
-			continue;
+
+	// What this pass has bound so far. The UI moves texture bindings about between frames, so each pass starts from nothing
+	int boundTransform = -1;
+	unsigned int boundVAO = 0;
+	unsigned int boundMaterial = RenderQueue::NO_MATERIAL;
+	unsigned int boundTextures[MAX_MESH_TEXTURES] = {};
+	UniformId samplerUniforms[MAX_MESH_TEXTURES] = {};
+	bool samplerSet[MAX_MESH_TEXTURES] = {};
+
+	int drawCalls = 0, vaoBinds = 0, textureBinds = 0, materialChanges = 0, uniformUploads = 0, bindsSkipped = 0;
+
+	if (pass == RenderPass::Main) {
+		// Bind the shadow map once for the pass, mesh textures only use the units below it
+		glActiveTexture(GL_TEXTURE10);
+		glBindTexture(GL_TEXTURE_2D, getDepthMap());
+		textureBinds++;
+		catchOpenGLErrors("DepthMap bind");
+	}
+
+	for (const RenderCommand* command = renderQueue.begin(pass); command != renderQueue.end(pass); command++) {
+		const FrameDrawItem& item = packet->drawItems[command->item];
+
+		// Only upload the model matrix when we move on to another renderable
+		if (item.transform != boundTransform) {
+			shader->setMat4(UNIFORM_MODEL, modelMatrices[item.transform]);
+			boundTransform = item.transform;
+			uniformUploads++;
 		}
-		
-		numMeshes = r.second->getNumberOfMeshes();
-		// render the loaded model
-		glm::mat4 modelm = glm::mat4(1.0f);
-		modelm = glm::translate(modelm, r.second->getPosition());
-		modelm = glm::scale(modelm, r.second->getScale());
-		modelm = glm::rotate(modelm, glm::radians(r.second->getRotation().x), glm::vec3(1.0f, 0.0f, 0.0f)); //X
-		modelm = glm::rotate(modelm, glm::radians(r.second->getRotation().y), glm::vec3(0.0f, 1.0f, 0.0f)); //Y
-		modelm = glm::rotate(modelm, glm::radians(r.second->getRotation().z), glm::vec3(0.0f, 0.0f, 1.0f)); //Z
-		shader->setMat4("model", modelm);
-		
-		for (int i = 0; i < numMeshes; i++) {
-			unsigned int diffuseNr = 1;
-			unsigned int specularNr = 1;
-			auto textures = r.second->getMeshAt(i).getTextures();
-			auto numIndicies = r.second->getMeshAt(i).getNumberOfIndices();
-			for (unsigned int i = 0; i < std::min((int)textures.size(), 9); i++) {
-				//dout.verbose("Binding texture " + std::to_string(i));
-				glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
-				// retrieve texture number (the N in diffuse_textureN)
-				catchOpenGLErrors("Texture select on mesh " + std::to_string(i));
-
-				string number;
-				string name = textures[i].type;
-				if (name == "texture_diffuse")
-					number = std::to_string(diffuseNr++);
-				else if (name == "texture_specular")
-					number = std::to_string(specularNr++);
-
-				shader->setInt(("material." + name + number).c_str(), i);
-				glBindTexture(GL_TEXTURE_2D, textures[i].id);
-				catchOpenGLErrors("Texture bind on mesh " + std::to_string(i));
+
+		// Draws with the same textures are next to each other, and textures already on their unit are left alone
+		if (command->material != boundMaterial) {
+			const RenderMaterial& material = renderQueue.getMaterialById(command->material);
+			for (int i = 0; i < material.count; i++) {
+				if (!samplerSet[i] || samplerUniforms[i] != material.uniforms[i]) {
+					shader->setInt(material.uniforms[i], i);
+					samplerUniforms[i] = material.uniforms[i];
+					samplerSet[i] = true;
+					uniformUploads++;
+				}
+				else {
+					bindsSkipped++;
+				}
+				if (boundTextures[i] != material.textures[i]) {
+					glActiveTexture(GL_TEXTURE0 + i);
+					glBindTexture(GL_TEXTURE_2D, material.textures[i]);
+					boundTextures[i] = material.textures[i];
+					textureBinds++;
+				}
+				else {
+					bindsSkipped++;
+				}
 			}
-			// Bind the shadow map
-			glActiveTexture(GL_TEXTURE10);
-			glBindTexture(GL_TEXTURE_2D, getDepthMap());
-			catchOpenGLErrors("DepthMap bind");
-
-			// draw mesh
-			r.second->getMeshAt(i).GL_bindVertexArray();
-			catchOpenGLErrors("VBO bind on mesh " + std::to_string(i));
-			glDrawElements(GL_TRIANGLES, numIndicies, GL_UNSIGNED_INT, 0);
-			catchOpenGLErrors("Draw on mesh " + std::to_string(i));
-			glBindVertexArray(0);
+			catchOpenGLErrors("Texture bind on mesh");
+			boundMaterial = command->material;
+			materialChanges++;
 		}
+
+		// draw mesh, meshes in the same geometry page draw without a rebind
+		const mtopengl::VAODef* def = mtopengl::getVAO(item.vao);
+		if (def == NULL)
+			continue;
+		if (def->VAO != boundVAO) {
+			glBindVertexArray(def->VAO);
+			boundVAO = def->VAO;
+			vaoBinds++;
+		}
+		glDrawElementsBaseVertex(GL_TRIANGLES, def->numIndices, def->indexType, (void*)((size_t)def->firstIndex * mtopengl::getIndexSize(def->indexType)), def->baseVertex);
+		catchOpenGLErrors("Draw on mesh");
+		drawCalls++;
 	}
+	glBindVertexArray(0);
+	glActiveTexture(GL_TEXTURE0);
+
+	profiler::addCounterToCurrentFrame("Renderer::drawCalls", drawCalls);
+	profiler::addCounterToCurrentFrame("Renderer::vaoBinds", vaoBinds);
+	profiler::addCounterToCurrentFrame("Renderer::textureBinds", textureBinds);
+	profiler::addCounterToCurrentFrame("Renderer::materialChanges", materialChanges);
+	profiler::addCounterToCurrentFrame("Renderer::uniformUploads", uniformUploads);
+	profiler::addCounterToCurrentFrame("Renderer::bindsSkipped", bindsSkipped);
 }
 
 void Renderer::render() {
-	// Lock the renderables and renderableUIs
-	std::scoped_lock lock(renderables_mutex, renderableUIs_mutex);
-
 	profiler::ScopeProfiler renderProfiler("Renderer.cpp::Renderer::render()");
 
 	//dout.verbose("render()");
 
+	// Take the newest frame the main thread has published, nothing in it changes while we draw
+	FramePacket* packet = framePackets.getFront();
+
+	// Work out where we are between simulation states once for the whole frame, and build every model matrix once for both passes
+	float alpha = getInterpolationAlpha(packet);
+	modelMatrices.resize(packet->transforms.size());
+	for (size_t i = 0; i < packet->transforms.size(); i++) {
+		modelMatrices[i] = buildModelMatrix(packet->transforms[i], alpha);
+	}
+
+	// The camera is driven by input on this thread, so it is snapshotted here rather than in the packet to avoid adding a tick of input latency
+	glm::vec3 cameraPosition = camera->getPosition();
+	glm::mat4 projection = glm::perspective(glm::radians(camera->getZoom()), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, appSettings->opengl_nearZ.load(), appSettings->opengl_farZ.load());
+	glm::mat4 view = camera->GetViewMatrix();
+
 	// We render shadows
 	//dout.verbose("defaultShadowShader use");
 	defaultShadowShader->use();
@@ -307,14 +555,17 @@ void Renderer::render() {
 	glViewport(0, 0, getShadowWidth(), getShadowHeight());
 
 	// Set the light view to LIGHT 1, only light 1 casts shadows
-	glm::vec3 lightPos = getLightPosition(1);
+	glm::vec3 lightPos = packet->lightPositions[1];
 	glm::vec3 lookingAt = glm::vec3(lightPos.x, 0, lightPos.z);
 	glm::mat4 lightView = glm::lookAt(lightPos, lookingAt, glm::vec3(0.0f, 1.0f, 0.0f));
 	// Create the light space matrix
 	glm::mat4 lightSpaceMatrix = lightProjection * lightView;
 
+	// Sort every draw of both passes by the state it needs
+	queueDraws(packet, cameraPosition, appSettings->opengl_farZ.load(), lightPos, far_plane);
+
 	// Pass the space matrix to the shadow shader
-	defaultShadowShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+	defaultShadowShader->setMat4(UNIFORM_LIGHT_SPACE_MATRIX, lightSpaceMatrix);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, getDepthMapFBO());
 	glClear(GL_DEPTH_BUFFER_BIT);
@@ -322,7 +573,7 @@ void Renderer::render() {
 	catchOpenGLErrors("DepthMapFBO bind");
 
 	// Render scene to shadow buffer
-	draw(defaultShadowShader);
+	draw(defaultShadowShader, RenderPass::Shadow, packet);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -332,29 +583,26 @@ void Renderer::render() {
 	// Pass the space matrix to the drawing shader
 	//dout.verbose("defaultShader use");
 	defaultShader->use();
-	defaultShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+	defaultShader->setMat4(UNIFORM_LIGHT_SPACE_MATRIX, lightSpaceMatrix);
 	catchOpenGLErrors("lightSpaceMatrix bind");
 
 	// Clear the screen to black
 	clearscreen();
 
 	// Put in the lighting info
-	prepLights(defaultShader);
+	prepLights(defaultShader, packet, cameraPosition);
 
 	catchOpenGLErrors("Light bind");
 
 	// view/projection matricies input
-
-	glm::mat4 projection = glm::perspective(glm::radians(camera->getZoom()), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, appSettings->opengl_nearZ.load(), appSettings->opengl_farZ.load());
-	glm::mat4 view = camera->GetViewMatrix();
 	//glm::mat4 view = glm::lookAt(camera->Position, glm::vec3(camera->Position.x, 0, camera->Position.z), camera->WorldUp);
-	defaultShader->setMat4("projection", projection);
-	defaultShader->setMat4("view", view);
+	defaultShader->setMat4(UNIFORM_PROJECTION, projection);
+	defaultShader->setMat4(UNIFORM_VIEW, view);
 	catchOpenGLErrors("Mat4s bind");
 
 	// Draw again
-	draw(defaultShader);
+	draw(defaultShader, RenderPass::Main, packet);
 
 	// Draw the UI
-	drawUi();
+	drawUi(packet);
 }
\ No newline at end of file
@@ -18,6 +18,8 @@ Attempted thread safety
 
 #include <atomic>
 #include <mutex>
+#include <chrono>
+#include <array>
 
 #include "Log.hpp"
 #include "Camera.hpp"
@@ -25,6 +27,8 @@ Attempted thread safety
 #include "ApplicationSettings.hpp"
 #include "Renderable.hpp"
 #include "UiHandler.hpp"
+#include "FramePacket.hpp"
+#include "RenderQueue.hpp"
 
 #include "DarkSunProfiler.hpp"
 
@@ -35,7 +39,7 @@ namespace darksun {
 	public:
 		const int SCREEN_WIDTH = 1768;
 		const int SCREEN_HEIGHT = 992;
-		const static int NUMBER_OF_LIGHTS = 4; // WARNING: You must update the number of lights the shader can take if you update this value!!!!!
+		const static int NUMBER_OF_LIGHTS = FramePacket::NUMBER_OF_LIGHTS;
 
 		/*
 		Creation
@@ -45,12 +49,18 @@ namespace darksun {
 		}
 		// Used to create the necessary resources on open of the program
 		void create(ApplicationSettings* settings);
+		// Creates only what the simulation needs (the camera), with no window or OpenGL context. Nothing can be drawn
+		void createHeadless(ApplicationSettings* settings);
+		bool isHeadless() { return headless; }
 		// (Re)Creates the window with the specified settings (passed by reference)
 		void createWindow(sf::ContextSettings& settings);
 
-		// Draws all registered Renderables
+		// Draws the latest published frame packet. Takes no scene locks, only call from the rendering thread
 		void render();
 
+		// Snapshots the registered Renderables, UIs and lights into a frame packet for the rendering thread. Only call from the main thread
+		void publishFrame();
+
 		// Registers renderables
 		void registerRenderable(string name, std::shared_ptr<Renderable> n);
 
@@ -98,6 +108,13 @@ namespace darksun {
 		// sets if gamma correction is enabled in the shaders
 		void setGammaCorrection(bool g);
 
+		// Stores the current transform of every renderable as the previous simulation state, called before each fixed simulation tick
+		void storePreviousTransforms();
+		// Marks that a fixed simulation tick of length step has just completed, renderables are interpolated from this point
+		void markSimulationTick(float step);
+		// Disables interpolation, renderables are drawn at their current transform
+		void disableInterpolation() { interpolationEnabled = false; }
+
 		unsigned int getShadowWidth() { return SHADOW_WIDTH; }
 		unsigned int getShadowHeight() { return SHADOW_HEIGHT; }
 		unsigned int getDepthMapFBO() { 
@@ -109,8 +126,11 @@ namespace darksun {
 			return depthMap;
 		}
 
+		// Returns NULL when headless
 		sf::RenderWindow* getWindowHandle() {
 			std::lock_guard lock(defaultWindow_mutex);
+			if (headless)
+				return NULL;
 			return &defaultWindow;
 		}
 
@@ -136,6 +156,7 @@ namespace darksun {
 
 		std::mutex defaultWindow_mutex;
 		sf::RenderWindow defaultWindow;
+		std::atomic<bool> headless = false;
 
 		std::mutex camera_mutex;
 		std::shared_ptr<Camera> camera; // we do nothing to protect the thread safety of camera, only to handle the thread safety of the pointer
@@ -166,8 +187,16 @@ namespace darksun {
 			true
 		};
 
-		// Applies the current lighting effects
-		void prepLights(std::shared_ptr<Shader> shader);
+		// Frame packets published by the main thread for the rendering thread
+		FramePacketExchange framePackets;
+		unsigned long long framesPublished = 0;
+		// Model matrix for each transform in the packet being drawn, only used by the rendering thread
+		std::vector<glm::mat4> modelMatrices;
+		// Draws of the packet being drawn sorted by the state they need, only used by the rendering thread
+		RenderQueue renderQueue;
+
+		// Applies the lighting effects in the packet
+		void prepLights(std::shared_ptr<Shader> shader, FramePacket* packet, glm::vec3 viewPos);
 
 		// Inits the shadow buffers
 		void initShadows();
@@ -175,11 +204,18 @@ namespace darksun {
 		// Inits the shaders
 		void initShaders();
 
-		// Draws the scene
-		void draw(std::shared_ptr<Shader> shader);
+		// Fills the render queue with a draw in each pass for every mesh in the packet, and sorts it. Depth is measured from the
+		// camera for the main pass and from the light for the shadow pass
+		void queueDraws(FramePacket* packet, glm::vec3 cameraPosition, float farZ, glm::vec3 lightPosition, float lightFarZ);
+
+		// Draws one pass of the render queue, only binding what changes from one draw to the next
+		void draw(std::shared_ptr<Shader> shader, RenderPass pass, FramePacket* packet);
+
+		// Returns how far we are between the previous and current simulation state of the packet (0 - 1)
+		float getInterpolationAlpha(FramePacket* packet);
 
 		// Draws the UI
-		void drawUi();
+		void drawUi(FramePacket* packet);
 
 		// Default shader
 		std::shared_ptr<Shader> defaultShader;
@@ -188,6 +224,11 @@ namespace darksun {
 
 		std::atomic<bool> gammaCorrection = false;
 
+		// Fixed timestep interpolation, main thread only. Copied into each packet
+		bool interpolationEnabled = false;
+		long long lastSimulationTick = 0; // steady_clock time of the last tick, in nanoseconds
+		float simulationStep = 0.0f;
+
 		// Shadows
 		const unsigned int SHADOW_WIDTH = 4096, SHADOW_HEIGHT = 4096;
 		std::mutex depthMapFBO_mutex;
@@ -196,7 +237,7 @@ namespace darksun {
 		unsigned int depthMap;
 		float depthBorderColor[4] = { 1.0, 1.0, 1.0, 1.0 };
 
-		void catchOpenGLErrors(string ref);
+		void catchOpenGLErrors(const char* ref);
 
 	};
 
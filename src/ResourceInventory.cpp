@@ -0,0 +1,193 @@
+/**
+
+File: ResourceInventory.cpp
+Description:
+
+Keeps count of the GPU memory DarkSun has asked for
+
+*/
+
+#include "ResourceInventory.hpp"
+
+using namespace darksun;
+
+// How often the whole inventory is written to the log
+static const std::chrono::seconds LOG_INTERVAL = std::chrono::seconds(30);
+
+static std::mutex inventory_mutex = std::mutex();
+
+// Totals by type, owner name and scene
+typedef std::tuple<int, string, int> InventoryKey;
+static std::map<InventoryKey, mtopengl::ResourceTotals> inventory = std::map<InventoryKey, mtopengl::ResourceTotals>();
+
+static thread_local mtopengl::ResourceOwner currentOwner = mtopengl::ResourceOwner();
+
+static std::chrono::steady_clock::time_point lastLogged = std::chrono::steady_clock::now();
+
+/**
+
+Owners
+
+*/
+
+mtopengl::OwnerScope::OwnerScope(const ResourceOwner& owner) {
+	previous = currentOwner;
+	currentOwner = owner;
+}
+
+mtopengl::OwnerScope::OwnerScope(const string& name) {
+	previous = currentOwner;
+	currentOwner.name = name;
+}
+
+mtopengl::OwnerScope::OwnerScope(int scene) {
+	previous = currentOwner;
+	currentOwner.scene = scene;
+}
+
+mtopengl::OwnerScope::~OwnerScope() {
+	currentOwner = previous;
+}
+
+mtopengl::ResourceOwner mtopengl::getCurrentOwner() {
+	return currentOwner;
+}
+
+mtopengl::ResourceOwner mtopengl::getTextureCacheOwner() {
+	ResourceOwner owner;
+	owner.name = "texture cache";
+	owner.scene = 0;
+	return owner;
+}
+
+/**
+
+Accounting
+
+*/
+
+void mtopengl::addResource(ResourceType type, const ResourceOwner& owner, size_t bytes) {
+	std::lock_guard lock(inventory_mutex);
+	ResourceTotals& totals = inventory[InventoryKey((int)type, owner.name, owner.scene)];
+	totals.bytes += bytes;
+	totals.count++;
+}
+
+void mtopengl::removeResource(ResourceType type, const ResourceOwner& owner, size_t bytes) {
+	std::lock_guard lock(inventory_mutex);
+	auto it = inventory.find(InventoryKey((int)type, owner.name, owner.scene));
+	if (it == inventory.end() || it->second.count == 0 || it->second.bytes < bytes) {
+		dout.warn("ResourceInventory --> Removed more " + resourceTypeToString(type) + " than '" + owner.name + "' (scene " + std::to_string(owner.scene) + ") had");
+		return;
+	}
+	it->second.bytes -= bytes;
+	it->second.count--;
+	if (it->second.count == 0)
+		inventory.erase(it);
+}
+
+mtopengl::ResourceTotals mtopengl::getResourceTotals(ResourceType type) {
+	std::lock_guard lock(inventory_mutex);
+	ResourceTotals totals;
+	for (auto const& i : inventory) {
+		if (std::get<0>(i.first) == (int)type) {
+			totals.bytes += i.second.bytes;
+			totals.count += i.second.count;
+		}
+	}
+	return totals;
+}
+
+mtopengl::ResourceTotals mtopengl::getSceneResourceTotals(int scene, ResourceType type) {
+	std::lock_guard lock(inventory_mutex);
+	ResourceTotals totals;
+	for (auto const& i : inventory) {
+		if (std::get<0>(i.first) == (int)type && std::get<2>(i.first) == scene) {
+			totals.bytes += i.second.bytes;
+			totals.count += i.second.count;
+		}
+	}
+	return totals;
+}
+
+std::map<std::pair<string, int>, mtopengl::ResourceTotals> mtopengl::getOwnerResourceTotals(ResourceType type) {
+	std::lock_guard lock(inventory_mutex);
+	std::map<std::pair<string, int>, ResourceTotals> owners;
+	for (auto const& i : inventory) {
+		if (std::get<0>(i.first) == (int)type)
+			owners[std::make_pair(std::get<1>(i.first), std::get<2>(i.first))] = i.second;
+	}
+	return owners;
+}
+
+/**
+
+Reporting
+
+*/
+
+static string toMB(size_t bytes) {
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.2fMB", (double)bytes / (1024.0 * 1024.0));
+	return string(buffer);
+}
+
+void mtopengl::reportResources() {
+	for (int t = 0; t < (int)ResourceType::COUNT; t++) {
+		ResourceTotals totals = getResourceTotals((ResourceType)t);
+		string name = resourceTypeToString((ResourceType)t);
+		profiler::addCounterToCurrentFrame("gpu::" + name + "Bytes", totals.bytes);
+		profiler::addCounterToCurrentFrame("gpu::" + name + "Count", totals.count);
+	}
+	profiler::addCounterToCurrentFrame("gpu::totalBytes", getTotalResourceBytes());
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastLogged >= LOG_INTERVAL) {
+		lastLogged = now;
+		logResources();
+	}
+}
+
+size_t mtopengl::getTotalResourceBytes() {
+	size_t total = 0;
+	for (int t = 0; t < (int)ResourceType::COUNT; t++) {
+		if ((ResourceType)t != ResourceType::PooledGeometry)
+			total += getResourceTotals((ResourceType)t).bytes;
+	}
+	return total;
+}
+
+void mtopengl::logResources() {
+	string line = "";
+	for (int t = 0; t < (int)ResourceType::COUNT; t++) {
+		ResourceTotals totals = getResourceTotals((ResourceType)t);
+		line += " " + resourceTypeToString((ResourceType)t) + "=" + toMB(totals.bytes) + "/" + std::to_string(totals.count);
+	}
+	dout.log("ResourceInventory --> GPU memory in use " + toMB(getTotalResourceBytes()) + ":" + line);
+
+	for (int t = 0; t < (int)ResourceType::COUNT; t++) {
+		for (auto const& o : getOwnerResourceTotals((ResourceType)t)) {
+			dout.verbose("ResourceInventory -->   " + resourceTypeToString((ResourceType)t) + " '" + o.first.first + "' scene " + std::to_string(o.first.second) +
+				": " + toMB(o.second.bytes) + " in " + std::to_string(o.second.count));
+		}
+	}
+}
+
+string mtopengl::resourceTypeToString(ResourceType type) {
+	switch (type) {
+	case ResourceType::Texture: return "texture";
+	case ResourceType::Geometry: return "geometry";
+	case ResourceType::PooledGeometry: return "pooledGeometry";
+	case ResourceType::GeometryPages: return "geometryPages";
+	case ResourceType::StagingBuffer: return "stagingBuffer";
+	default: return "unknown";
+	}
+}
+
+mtopengl::ResourceType mtopengl::resourceTypeFromString(string name) {
+	for (int t = 0; t < (int)ResourceType::COUNT; t++) {
+		if (resourceTypeToString((ResourceType)t) == name)
+			return (ResourceType)t;
+	}
+	return ResourceType::COUNT;
+}
@@ -0,0 +1,101 @@
+#pragma once
+/**
+
+File: ResourceInventory.hpp
+Description:
+
+Keeps count of the GPU memory DarkSun has asked for, by resource type, by owner (the map, an entity blueprint, the engine
+itself) and by scene. Resources pick up their owner from the OwnerScope active on the thread that requests them, so whoever
+creates a mesh or requests a texture only has to open a scope around it.
+
+A texture shared by several owners is counted against the first to request it. Textures nobody references any more but that
+are kept resident for the next scene are counted against the texture cache until they are reused or evicted.
+
+THREADING IN OPERATION, thread safe
+
+*/
+
+#include <string>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <chrono>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+
+using string = std::string;
+
+namespace darksun::mtopengl {
+
+	enum class ResourceType {
+		Texture = 0,	// Streamed in textures, all mip levels
+		Geometry,		// Vertices and indices of meshes with buffers of their own
+		PooledGeometry,	// Vertices and indices of meshes in geometry pool pages. Already part of GeometryPages, so not in the total
+		GeometryPages,	// Geometry pool pages, used or not
+		StagingBuffer,	// Upload rings
+		COUNT
+	};
+
+	struct ResourceOwner {
+		string name = "engine";
+		int scene = 0; // 0 for resources that belong to no scene
+	};
+
+	// Owner of anything requested from here on by this thread, until the scope closes
+	class OwnerScope {
+
+	public:
+		// Sets the whole owner
+		OwnerScope(const ResourceOwner& owner);
+		// Sets the owner name, keeping the scene
+		OwnerScope(const string& name);
+		// Sets the scene, keeping the owner name
+		OwnerScope(int scene);
+		~OwnerScope();
+
+		OwnerScope(const OwnerScope&) = delete;
+		OwnerScope& operator=(const OwnerScope&) = delete;
+
+	private:
+		ResourceOwner previous;
+	};
+
+	struct ResourceTotals {
+		size_t bytes = 0;
+		int count = 0;
+	};
+
+	// The owner that resources requested on this thread right now are counted against
+	ResourceOwner getCurrentOwner();
+
+	// Owner of resident textures nobody references
+	ResourceOwner getTextureCacheOwner();
+
+	// Counts a resource in or out. Any thread
+	void addResource(ResourceType type, const ResourceOwner& owner, size_t bytes);
+	void removeResource(ResourceType type, const ResourceOwner& owner, size_t bytes);
+
+	// Totals of one type, across everything or for one scene. Any thread
+	ResourceTotals getResourceTotals(ResourceType type);
+	ResourceTotals getSceneResourceTotals(int scene, ResourceType type);
+
+	// Totals by owner and scene for one type. Any thread
+	std::map<std::pair<string, int>, ResourceTotals> getOwnerResourceTotals(ResourceType type);
+
+	// Adds the totals to the current profiler frame, and writes the whole inventory to the log every LOG_INTERVAL. Called once a
+	// frame by the OpenGL thread
+	void reportResources();
+
+	// Writes the whole inventory to the log now
+	void logResources();
+
+	// Returns the bytes of every type that takes GPU memory of its own
+	size_t getTotalResourceBytes();
+
+	string resourceTypeToString(ResourceType type);
+
+	// Returns ResourceType::COUNT if the name is unknown
+	ResourceType resourceTypeFromString(string name);
+
+}
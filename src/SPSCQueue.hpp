@@ -0,0 +1,67 @@
+#pragma once
+/**
+
+File: SPSCQueue.hpp
+Description:
+
+A bounded lock free ring buffer for exactly one producer thread and one consumer thread. Capacity must be a power of two.
+Pushing never blocks, when the ring is full the push fails and the caller decides what to drop.
+
+THREADING IN OPERATION, thread safe for one producer and one consumer
+
+*/
+
+#include <atomic>
+#include <cstddef>
+
+namespace darksun {
+
+	template<typename T, size_t CAPACITY>
+	class SPSCQueue {
+		static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+	public:
+		// Adds an item to the back of the queue. Returns false if the queue is full. Producer only
+		bool push(const T& item) {
+			size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) >= CAPACITY) {
+				return false;
+			}
+			items[t & MASK] = item;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Moves up to max items from the front of the queue into buffer, returns how many were moved. Consumer only
+		size_t pop(T* buffer, size_t max) {
+			size_t h = head.load(std::memory_order_relaxed);
+			size_t available = tail.load(std::memory_order_acquire) - h;
+			size_t count = (available < max) ? available : max;
+			for (size_t i = 0; i < count; i++) {
+				buffer[i] = items[(h + i) & MASK];
+			}
+			head.store(h + count, std::memory_order_release);
+			return count;
+		}
+
+		// Returns roughly how many items are queued, exact only when called from the producer or consumer with the other idle
+		size_t size() {
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+
+		size_t capacity() {
+			return CAPACITY;
+		}
+
+	private:
+		const static size_t MASK = CAPACITY - 1;
+
+		T items[CAPACITY];
+
+		// Kept on separate cache lines so the producer and consumer don't fight over them
+		alignas(64) std::atomic<size_t> head = 0; // next slot to read, written by the consumer
+		alignas(64) std::atomic<size_t> tail = 0; // next slot to write, written by the producer
+
+	};
+
+}
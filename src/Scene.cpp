@@ -28,7 +28,7 @@ Scene::Scene(std::shared_ptr<Renderer> r, ApplicationSettings* appSettings, Scen
 
 	dout.log("Scene constructor called");
 
-	init();
+	// Nothing here touches the renderer or the running scene, so scenes can be built on a worker while another is active
 
 	// Create the Terrain
 	if (hasMap) {
@@ -38,8 +38,6 @@ Scene::Scene(std::shared_ptr<Renderer> r, ApplicationSettings* appSettings, Scen
 			dout.error("Terrain is invalid, switching off terrain to prevent issues");
 			hasMap = false;
 		}
-		// Register the map with the renderer
-		r->registerRenderable("map", std::dynamic_pointer_cast<Renderable>(map));
 	}
 
 	// Create the ui
@@ -48,9 +46,24 @@ Scene::Scene(std::shared_ptr<Renderer> r, ApplicationSettings* appSettings, Scen
 	EntityOrders::hookClass(ui->getUiEngine()->getState());
 	if(hasMap)
 		map->hookClass(ui->getUiEngine()->getState()); // Hook the map for the scene UI
-	ui->OnCreate();
 
 	// Create our loading UI
+	loadingUi = std::shared_ptr<UIWrangler>(new UIWrangler(renderer->getWindowHandle(), renderer->getCamera(), appSettings, "loading"));
+
+	// Hook the loading percentage into the lua engine
+	hookClass(loadingUi->getUiEngine()->getState());
+}
+
+void Scene::activate() {
+	init();
+
+	if (hasMap) {
+		// Register the map with the renderer
+		renderer->registerRenderable("map", std::dynamic_pointer_cast<Renderable>(map));
+	}
+
+	// The UI scripts can drive the renderer and camera, so they only start once we are the active scene
+	ui->OnCreate();
 	initLoadingUi();
 
 	// Check for map loading
@@ -86,11 +99,6 @@ void Scene::init() {
 }
 
 void Scene::initLoadingUi() {
-	loadingUi = std::shared_ptr<UIWrangler>(new UIWrangler(renderer->getWindowHandle(), renderer->getCamera(), appSettings, "loading"));
-
-	// Hook the loading percentage into the lua engine
-	hookClass(loadingUi->getUiEngine()->getState());
-
 	loadingUi->OnCreate();
 
 	tgui::ProgressBar::Ptr bar = loadingUi->getWidgetByName("loadingBar")->cast<tgui::ProgressBar>();
@@ -117,6 +125,8 @@ void Scene::hookClass(lua::State *L) {
 					.addFunction("getLightAttenuation", &darksun::Scene::lua_getLightAttenuation)
 					.addFunction("setCameraEnabled", &darksun::Scene::lua_setCameraEnabled)
 					.addFunction("setTacticalZoomSettings", &darksun::Scene::lua_setTacticalZoomSettings)
+					.addFunction("getGpuMemoryBytes", &darksun::Scene::lua_getGpuMemoryBytes)
+					.addFunction("getGpuResourceCount", &darksun::Scene::lua_getGpuResourceCount)
 				.endClass()
 			.endNamespace();
 
@@ -139,6 +149,14 @@ void Scene::close() {
 	else {
 		renderer->unregisterUI(sceneName + "_ui");
 	}
+
+	// And everything we drew, the next scene registers its own
+	if (hasMap) {
+		renderer->unregisterRenderable("map");
+	}
+	for (auto& e : entities) {
+		renderer->unregisterRenderable("entity" + std::to_string(e->getId()));
+	}
 }
 
 void Scene::handleEvent(sf::Event& ev) {
@@ -146,6 +164,8 @@ void Scene::handleEvent(sf::Event& ev) {
 }
 
 void Scene::tick(float deltaTime) {
+	// Anything the map or entities put on the GPU from here on belongs to this scene
+	mtopengl::OwnerScope ownerScope(myId);
 
 	// Tick the terrain
 	if(hasMap)
@@ -165,6 +185,7 @@ void Scene::tick(float deltaTime) {
 		// Register the running UI
 		renderer->registerUI(sceneName + "_ui", ui);
 		switchedUi = true;
+		profiler::markStartupPhase("map ready");
 	}
 
 	// Move the camera light to below the camera
@@ -182,18 +203,50 @@ void Scene::tick(float deltaTime) {
 
 	processSpawnEntityRequests();
 
+	// Check for entity failures we need to remove
 	for (auto& e : entities) {
-		// Check for entity failures we need to remove
 		if (!e->isValid()) {
 			// Remove the entity from the renderer first!
 			renderer->unregisterRenderable("entity" + std::to_string(e->getId()));
-
-			entities.erase(std::remove(entities.begin(), entities.end(), e), entities.end());
 		}
-		else {
-			e->tick(deltaTime);
+	}
+	entities.erase(std::remove_if(entities.begin(), entities.end(), [](std::shared_ptr<Entity>& e) { return !e->isValid(); }), entities.end());
+
+	// Entities only touch their own state (and their own LuaEngine) when ticking, so they are ticked across the job system. The
+	// owner scope is per thread, so each chunk opens this scene's again on whichever worker runs it
+	mtopengl::ResourceOwner owner = mtopengl::getCurrentOwner();
+	jobs::parallelFor("Scene::tick()entities", 0, (int)entities.size(), 4, [this, deltaTime, owner](int begin, int end) {
+		mtopengl::OwnerScope chunkOwnerScope(owner);
+		for (int i = begin; i < end; i++) {
+			entities[i]->tick(deltaTime);
+		}
+	});
+}
+
+double Scene::lua_getGpuMemoryBytes(string type) {
+	if (type == "all") {
+		double total = 0;
+		for (int t = 0; t < (int)mtopengl::ResourceType::COUNT; t++) {
+			if ((mtopengl::ResourceType)t != mtopengl::ResourceType::PooledGeometry)
+				total += (double)mtopengl::getSceneResourceTotals(myId, (mtopengl::ResourceType)t).bytes;
 		}
+		return total;
+	}
+	mtopengl::ResourceType t = mtopengl::resourceTypeFromString(type);
+	if (t == mtopengl::ResourceType::COUNT) {
+		dlua.error("Scene::getGpuMemoryBytes --> Unknown resource type '" + type + "'");
+		return 0;
+	}
+	return (double)mtopengl::getSceneResourceTotals(myId, t).bytes;
+}
+
+int Scene::lua_getGpuResourceCount(string type) {
+	mtopengl::ResourceType t = mtopengl::resourceTypeFromString(type);
+	if (t == mtopengl::ResourceType::COUNT) {
+		dlua.error("Scene::getGpuResourceCount --> Unknown resource type '" + type + "'");
+		return 0;
 	}
+	return mtopengl::getSceneResourceTotals(myId, t).count;
 }
 
 void Scene::processSpawnEntityRequests() {
@@ -16,6 +16,7 @@ Header file for Scene.cpp, defines all scenes
 #include "Log.hpp"
 #include "UiHandler.hpp"
 #include "Map.hpp"
+#include "JobSystem.hpp"
 
 #include <TGUI/TGUI.hpp>
 
@@ -93,19 +94,26 @@ namespace darksun {
 			renderer->getCamera()->update(glm::vec3(0.0f, 0.0f, 0.0f), 0.5f);
 		}
 		bool lua_hasMap() { return hasMap; }
+		// Bytes of GPU memory this scene uses of one type ("texture", "geometry", "pooledGeometry"...) or "all"
+		double lua_getGpuMemoryBytes(string type);
+		int lua_getGpuResourceCount(string type);
 
 	public:
 		static int createNewId();
 
+		// Builds the scene (map, UIs and their scripts) without touching the renderer, safe to call from a worker
 		Scene(std::shared_ptr<Renderer>, ApplicationSettings* appSettings, SceneInformation sceneInfo);
 
+		// Makes this the scene being shown: sets up the renderer, registers the map and UIs and runs the UI OnCreate. Main thread only
+		void activate();
+
 		// Pass events
 		void handleEvent(sf::Event& ev);
 
 		// Tick the scene
 		void tick(float deltaTime);
 
-		// Init function called to start the scene
+		// Init function called to start the scene, sets up the renderer and camera
 		void init();
 
 		// Inits the loading UI
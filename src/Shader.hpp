@@ -6,6 +6,10 @@
 
 Borrowed from https://learnopengl.com/code_viewer_gh.php?code=includes/learnopengl/shader_s.hpp
 
+Every active uniform and uniform block is looked up once after linking and kept by the FNV-1a hash of its name. Names written
+in the source hash at compile time, so the draw path sets uniforms by id without building strings or asking the driver.
+Arrays are kept under their bare name ("lightColors") as well as each element ("lightColors[2]").
+
 */
 
 #include "Log.hpp"
@@ -14,13 +18,87 @@ Borrowed from https://learnopengl.com/code_viewer_gh.php?code=includes/learnopen
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
 namespace darksun {
+
+	typedef uint32_t UniformId;
+
+	// FNV-1a of a uniform name. Pass the hash of a prefix as the second argument to carry on from it
+	constexpr UniformId uniformId(const char* name, UniformId hash = 2166136261u) {
+		while (*name != 0) {
+			hash = (hash ^ (UniformId)(unsigned char)*name) * 16777619u;
+			name++;
+		}
+		return hash;
+	}
+
 	class Shader {
 	private:
+		std::unordered_map<UniformId, GLint> uniformLocations;
+		std::unordered_map<UniformId, GLuint> uniformBlocks;
+
+		// fills the uniform caches from the linked program
+		// ------------------------------------------------------------------------
+		void reflectUniforms() {
+			uniformLocations.clear();
+			uniformBlocks.clear();
+			std::unordered_map<UniformId, std::string> seen;
+			auto remember = [&](const std::string& name) {
+				UniformId id = uniformId(name.c_str());
+				auto it = seen.find(id);
+				if (it != seen.end() && it->second != name)
+					dout.error("Shader --> Uniforms '" + it->second + "' and '" + name + "' have the same id in program " + std::to_string(ID));
+				seen[id] = name;
+				return id;
+			};
+
+			GLint count = 0, maxLength = 0;
+			glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+			glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+			std::vector<char> buffer(maxLength + 1);
+			for (GLint i = 0; i < count; i++) {
+				GLsizei length = 0;
+				GLint size = 0;
+				GLenum type;
+				glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+				std::string name(buffer.data(), length);
+				GLint location = glGetUniformLocation(ID, name.c_str());
+				// Uniforms inside blocks have no location of their own
+				if (location < 0)
+					continue;
+				if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+					std::string base = name.substr(0, name.size() - 3);
+					uniformLocations[remember(base)] = location;
+					for (GLint e = 0; e < size; e++) {
+						std::string element = base + "[" + std::to_string(e) + "]";
+						uniformLocations[remember(element)] = glGetUniformLocation(ID, element.c_str());
+					}
+				}
+				else {
+					uniformLocations[remember(name)] = location;
+				}
+			}
+
+			GLint blocks = 0;
+			maxLength = 0;
+			glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+			glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+			buffer.resize(maxLength + 1);
+			for (GLint i = 0; i < blocks; i++) {
+				GLsizei length = 0;
+				glGetActiveUniformBlockName(ID, (GLuint)i, (GLsizei)buffer.size(), &length, buffer.data());
+				uniformBlocks[remember(std::string(buffer.data(), length))] = (GLuint)i;
+			}
+
+			dout.verbose("Shader --> Program " + std::to_string(ID) + " has " + std::to_string(uniformLocations.size()) + " uniform locations and " +
+				std::to_string(uniformBlocks.size()) + " uniform blocks");
+		}
 		// utility function for checking shader compilation/linking errors.
 		// ------------------------------------------------------------------------
 		void checkCompileErrors(unsigned int shader, std::string type) {
@@ -113,6 +191,7 @@ namespace darksun {
 			glAttachShader(ID, geometry);
 			glLinkProgram(ID);
 			checkCompileErrors(ID, "PROGRAM");
+			reflectUniforms();
 			// delete the shaders as they're linked into our program now and no longer necessary
 			glDeleteShader(vertex);
 			glDeleteShader(fragment);
@@ -165,6 +244,7 @@ namespace darksun {
 			glAttachShader(ID, fragment);
 			glLinkProgram(ID);
 			checkCompileErrors(ID, "PROGRAM");
+			reflectUniforms();
 			// delete the shaders as they're linked into our program now and no longer necessary
 			glDeleteShader(vertex);
 			glDeleteShader(fragment);
@@ -177,63 +257,122 @@ namespace darksun {
 		void use() {
 			glUseProgram(ID);
 		}
-		// utility uniform functions
+		// uniform lookups
+		// ------------------------------------------------------------------------
+		// Returns -1 for names the linker dropped or that were never there, which glUniform* quietly ignores
+		GLint getUniformLocation(UniformId id) const
+		{
+			auto it = uniformLocations.find(id);
+			return (it == uniformLocations.end()) ? -1 : it->second;
+		}
+		GLint getUniformLocation(const std::string &name) const
+		{
+			return getUniformLocation(uniformId(name.c_str()));
+		}
+		// Binds a uniform block to a binding point, does nothing if the program doesn't have the block
+		void bindUniformBlock(UniformId id, GLuint binding) const
+		{
+			auto it = uniformBlocks.find(id);
+			if (it != uniformBlocks.end())
+				glUniformBlockBinding(ID, it->second, binding);
+		}
+		// utility uniform functions, by id on the draw path and by name everywhere else
 		// ------------------------------------------------------------------------
+		void setBool(UniformId id, bool value) const
+		{
+			glUniform1i(getUniformLocation(id), (int)value);
+		}
 		void setBool(const std::string &name, bool value) const
 		{
-			glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+			setBool(uniformId(name.c_str()), value);
 		}
 		// ------------------------------------------------------------------------
+		void setInt(UniformId id, int value) const
+		{
+			glUniform1i(getUniformLocation(id), value);
+		}
 		void setInt(const std::string &name, int value) const
 		{
-			glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+			setInt(uniformId(name.c_str()), value);
+		}
+		void setIntArray(UniformId id, int count, const int* values) const
+		{
+			glUniform1iv(getUniformLocation(id), count, values);
 		}
 		// ------------------------------------------------------------------------
+		void setFloat(UniformId id, float value) const
+		{
+			glUniform1f(getUniformLocation(id), value);
+		}
 		void setFloat(const std::string &name, float value) const
 		{
-			glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+			setFloat(uniformId(name.c_str()), value);
 		}
 		// ------------------------------------------------------------------------
+		void setVec2(UniformId id, const glm::vec2 &value) const
+		{
+			glUniform2fv(getUniformLocation(id), 1, &value[0]);
+		}
 		void setVec2(const std::string &name, const glm::vec2 &value) const
 		{
-			glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+			setVec2(uniformId(name.c_str()), value);
 		}
 		void setVec2(const std::string &name, float x, float y) const
 		{
-			glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+			glUniform2f(getUniformLocation(name), x, y);
 		}
 		// ------------------------------------------------------------------------
+		void setVec3(UniformId id, const glm::vec3 &value) const
+		{
+			glUniform3fv(getUniformLocation(id), 1, &value[0]);
+		}
+		void setVec3(UniformId id, float x, float y, float z) const
+		{
+			glUniform3f(getUniformLocation(id), x, y, z);
+		}
 		void setVec3(const std::string &name, const glm::vec3 &value) const
 		{
-			glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+			setVec3(uniformId(name.c_str()), value);
 		}
 		void setVec3(const std::string &name, float x, float y, float z) const
 		{
-			glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+			setVec3(uniformId(name.c_str()), x, y, z);
+		}
+		void setVec3Array(UniformId id, int count, const glm::vec3* values) const
+		{
+			glUniform3fv(getUniformLocation(id), count, &values[0][0]);
 		}
 		// ------------------------------------------------------------------------
+		void setVec4(UniformId id, const glm::vec4 &value) const
+		{
+			glUniform4fv(getUniformLocation(id), 1, &value[0]);
+		}
 		void setVec4(const std::string &name, const glm::vec4 &value) const
 		{
-			glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+			setVec4(uniformId(name.c_str()), value);
 		}
 		void setVec4(const std::string &name, float x, float y, float z, float w)
 		{
-			glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+			glUniform4f(getUniformLocation(name), x, y, z, w);
 		}
 		// ------------------------------------------------------------------------
 		void setMat2(const std::string &name, const glm::mat2 &mat) const
 		{
-			glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+			glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 		}
 		// ------------------------------------------------------------------------
 		void setMat3(const std::string &name, const glm::mat3 &mat) const
 		{
-			glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+			glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 		}
 		// ------------------------------------------------------------------------
+		void setMat4(UniformId id, const glm::mat4 &mat) const
+		{
+			glUniformMatrix4fv(getUniformLocation(id), 1, GL_FALSE, &mat[0][0]);
+		}
 		void setMat4(const std::string &name, const glm::mat4 &mat) const
 		{
-			glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+			setMat4(uniformId(name.c_str()), mat);
 		}
 	};
 }
@@ -0,0 +1,167 @@
+#pragma once
+/**
+
+File: SlotMap.hpp
+Description:
+
+A table of values addressed by 32 bit generational handles. The low 20 bits of a handle are the slot index and the high 12 bits
+are the generation of the slot when it was handed out, so a handle to a released (and possibly reused) slot is detected rather
+than pointing at someone else's value. Handle 0 is never handed out and can be used as null.
+
+Slots are handed out from any thread and freed slots are reused first, keeping the table packed towards the start. The values
+live in fixed size pages that never move, so looking a handle up is O(1) and never takes a lock. Each value is written by one
+owner thread (publish), other threads can only ask whether it is ready.
+
+THREADING IN OPERATION, allocate/release/isReady from any thread, publish/get from the owner thread only
+
+*/
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace darksun {
+
+	typedef uint32_t SlotHandle;
+
+	template<typename T, uint32_t PAGE_SIZE = 1024>
+	class SlotMap {
+		static_assert(PAGE_SIZE > 0 && (PAGE_SIZE & (PAGE_SIZE - 1)) == 0, "SlotMap page size must be a power of two");
+
+	public:
+		const static uint32_t INDEX_BITS = 20;
+		const static uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+		const static uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+		const static uint32_t MAX_SLOTS = 1u << INDEX_BITS;
+
+		SlotMap() {
+			for (uint32_t i = 0; i < MAX_PAGES; i++) {
+				pages[i] = NULL;
+			}
+		}
+		~SlotMap() {
+			for (uint32_t i = 0; i < MAX_PAGES; i++) {
+				delete[] pages[i].load();
+			}
+		}
+
+		static uint32_t getIndex(SlotHandle h) { return h & INDEX_MASK; }
+		static uint32_t getGeneration(SlotHandle h) { return (h >> INDEX_BITS) & GENERATION_MASK; }
+
+		// Hands out a slot, which isn't ready until the owner publishes a value to it. Returns 0 if the table is full. Any thread
+		SlotHandle allocate() {
+			std::lock_guard lock(allocate_mutex);
+			uint32_t index;
+			if (!freeSlots.empty()) {
+				index = freeSlots.back();
+				freeSlots.pop_back();
+			}
+			else {
+				if (nextSlot >= MAX_SLOTS)
+					return 0;
+				index = nextSlot++;
+				uint32_t page = index / PAGE_SIZE;
+				if (pages[page].load(std::memory_order_relaxed) == NULL) {
+					pages[page].store(new Slot[PAGE_SIZE], std::memory_order_release);
+				}
+			}
+
+			Slot& slot = getSlot(index);
+			uint32_t generation = slot.tag.load(std::memory_order_relaxed) >> 1;
+			allocated++;
+			return (generation << INDEX_BITS) | index;
+		}
+
+		// Sets the value and marks the slot ready. Ignored for a stale handle. Owner thread only
+		void publish(SlotHandle h, const T& value) {
+			Slot* slot = find(h);
+			if (slot == NULL)
+				return;
+			slot->value = value;
+			slot->tag.store((getGeneration(h) << 1) | 1, std::memory_order_release);
+		}
+
+		// Returns the value, or NULL if the handle is stale or the slot isn't ready yet. O(1). Owner thread only
+		T* get(SlotHandle h) {
+			Slot* slot = find(h);
+			if (slot == NULL || slot->tag.load(std::memory_order_acquire) != ((getGeneration(h) << 1) | 1))
+				return NULL;
+			return &slot->value;
+		}
+
+		// Returns true once the value has been published and the handle is still live. Any thread
+		bool isReady(SlotHandle h) {
+			Slot* slot = find(h);
+			return slot != NULL && slot->tag.load(std::memory_order_acquire) == ((getGeneration(h) << 1) | 1);
+		}
+
+		// Returns true if the handle still refers to its slot, ready or not. Any thread
+		bool isValid(SlotHandle h) {
+			Slot* slot = find(h);
+			return slot != NULL && (slot->tag.load(std::memory_order_acquire) >> 1) == getGeneration(h);
+		}
+
+		// Frees the slot, every handle to it goes stale. The owner must not be using the value. Any thread
+		void release(SlotHandle h) {
+			Slot* slot = find(h);
+			if (slot == NULL)
+				return;
+
+			std::lock_guard lock(allocate_mutex);
+			uint32_t generation = getGeneration(h);
+			if ((slot->tag.load(std::memory_order_relaxed) >> 1) != generation)
+				return; // Already released
+
+			slot->value = T();
+			// Generation 0 is skipped so no handle is ever 0
+			uint32_t next = (generation + 1) & GENERATION_MASK;
+			if (next == 0)
+				next = 1;
+			slot->tag.store(next << 1, std::memory_order_release);
+			freeSlots.push_back(getIndex(h));
+			allocated--;
+		}
+
+		// Number of slots handed out and not released
+		uint32_t size() {
+			std::lock_guard lock(allocate_mutex);
+			return allocated;
+		}
+
+	private:
+		const static uint32_t MAX_PAGES = MAX_SLOTS / PAGE_SIZE;
+
+		struct Slot {
+			// Generation in the high bits, ready in the lowest bit
+			std::atomic<uint32_t> tag = (1u << 1);
+			T value = T();
+		};
+
+		std::atomic<Slot*> pages[MAX_PAGES];
+
+		std::mutex allocate_mutex;
+		std::vector<uint32_t> freeSlots;
+		uint32_t nextSlot = 0;
+		uint32_t allocated = 0;
+
+		Slot& getSlot(uint32_t index) {
+			return pages[index / PAGE_SIZE].load(std::memory_order_acquire)[index & (PAGE_SIZE - 1)];
+		}
+
+		Slot* find(SlotHandle h) {
+			if (h == 0)
+				return NULL;
+			uint32_t index = getIndex(h);
+			Slot* page = pages[index / PAGE_SIZE].load(std::memory_order_acquire);
+			if (page == NULL)
+				return NULL;
+			Slot* slot = &page[index & (PAGE_SIZE - 1)];
+			if ((slot->tag.load(std::memory_order_acquire) >> 1) != getGeneration(h))
+				return NULL;
+			return slot;
+		}
+	};
+
+}
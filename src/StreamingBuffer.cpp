@@ -0,0 +1,243 @@
+/**
+
+File: StreamingBuffer.cpp
+Description:
+
+A staging ring buffer for streaming data into other GPU buffers
+
+OpenGL thread ONLY
+
+*/
+
+#include "StreamingBuffer.hpp"
+
+using namespace darksun;
+
+void mtopengl::StreamingBuffer::init(GLsizeiptr size, CompletionQueue* completions) {
+	this->completions = completions;
+	capacity = size;
+	head = 0;
+	tail = 0;
+	unfenced = 0;
+	inFlight = 0;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+	persistent = GLEW_ARB_buffer_storage;
+	if (persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_READ_BUFFER, capacity, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, capacity, flags);
+		if (mapped == NULL) {
+			dout.warn("StreamingBuffer --> Persistent mapping failed, falling back to orphaning");
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			persistent = false;
+		}
+	}
+	if (!persistent) {
+		glBufferData(GL_COPY_READ_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	mtopengl::addResource(ResourceType::StagingBuffer, ResourceOwner(), capacity);
+	dout.log("StreamingBuffer --> Created " + std::to_string(capacity / (1024 * 1024)) + "MB staging ring (" + (persistent ? "persistent" : "orphaned") + ")");
+}
+
+GLsizeiptr mtopengl::StreamingBuffer::allocate(GLsizeiptr size) {
+	size = ((size + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT;
+
+	if (!persistent) {
+		// Orphan when we run off the end, the driver hands us fresh storage and keeps the old one alive for the GPU
+		if (head + size > capacity) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glBufferData(GL_COPY_READ_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+			head = 0;
+		}
+		GLsizeiptr offset = head;
+		head += size;
+		return offset;
+	}
+
+	while (true) {
+		GLsizeiptr used = unfenced + inFlight;
+		if (used == 0) {
+			head = 0;
+			tail = 0;
+		}
+
+		if (used < capacity && head >= tail) {
+			// In use from tail to head, free at the end and at the start
+			if (capacity - head >= size) {
+				GLsizeiptr offset = head;
+				head += size;
+				unfenced += size;
+				return offset;
+			}
+			if (tail >= size) {
+				// Skip what is left at the end, it is freed along with this batch
+				unfenced += capacity - head;
+				head = 0;
+				continue;
+			}
+		}
+		else if (tail - head >= size) {
+			// In use from tail round to head, free in between
+			GLsizeiptr offset = head;
+			head += size;
+			unfenced += size;
+			return offset;
+		}
+
+		// No room, wait for the GPU to finish copying out of the oldest region
+		profiler::ScopeProfiler waitProfiler("StreamingBuffer.cpp::StreamingBuffer::allocate()gpuWait");
+		if (regions.empty())
+			fence();
+		retireOldest();
+	}
+}
+
+void mtopengl::StreamingBuffer::retireOldest() {
+	if (regions.empty())
+		return;
+	Region& oldest = regions.front();
+	GLenum result = glClientWaitSync(oldest.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1s, so a lost context can't hang us
+	if (result == GL_WAIT_FAILED || result == GL_TIMEOUT_EXPIRED) {
+		dout.error("StreamingBuffer --> Waiting on a staging region failed, reusing it anyway");
+	}
+	glDeleteSync(oldest.sync);
+	tail = (tail + oldest.size) % capacity;
+	inFlight -= oldest.size;
+	regions.pop_front();
+}
+
+GLsizeiptr mtopengl::StreamingBuffer::stage(const void* data, GLsizeiptr size) {
+	if (buffer == 0 || size <= 0 || size > capacity / 2)
+		return -1;
+
+	GLsizeiptr stagingOffset = allocate(size);
+
+	if (persistent) {
+		// Coherent, so nothing to flush
+		std::memcpy(mapped + stagingOffset, data, size);
+		return stagingOffset;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	void* ptr = glMapBufferRange(GL_COPY_READ_BUFFER, stagingOffset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (ptr == NULL) {
+		dout.error("StreamingBuffer --> Failed to map the staging ring");
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		return -1;
+	}
+	std::memcpy(ptr, data, size);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	return stagingOffset;
+}
+
+void mtopengl::StreamingBuffer::upload(GLuint target, GLintptr offset, const void* data, GLsizeiptr size) {
+	if (size <= 0)
+		return;
+
+	GLsizeiptr stagingOffset = stage(data, size);
+	if (stagingOffset < 0 && completions != NULL) {
+		// Too big for the ring, it gets a staging buffer to itself until the GPU has copied out of it
+		StagingBuffer staging = takeSpare(size);
+		glBindBuffer(GL_COPY_READ_BUFFER, staging.buffer);
+		glBufferSubData(GL_COPY_READ_BUFFER, 0, size, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, size);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		completions->whenComplete([this, staging]() { returnSpare(staging); });
+		profiler::addCounterToCurrentFrame("StreamingBuffer::pooledUploads", 1);
+		return;
+	}
+	if (stagingOffset < 0) {
+		// Too big to stage, let the driver deal with it
+		glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, stagingOffset, offset, size);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+mtopengl::StreamingBuffer::StagingBuffer mtopengl::StreamingBuffer::takeSpare(GLsizeiptr size) {
+	auto best = spareBuffers.end();
+	for (auto it = spareBuffers.begin(); it != spareBuffers.end(); it++) {
+		if (it->size >= size && (best == spareBuffers.end() || it->size < best->size))
+			best = it;
+	}
+	if (best != spareBuffers.end()) {
+		StagingBuffer staging = *best;
+		spareBuffers.erase(best);
+		return staging;
+	}
+
+	StagingBuffer staging;
+	staging.size = ((size + SPARE_GRANULARITY - 1) / SPARE_GRANULARITY) * SPARE_GRANULARITY;
+	glGenBuffers(1, &staging.buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, staging.buffer);
+	glBufferData(GL_COPY_READ_BUFFER, staging.size, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	mtopengl::addResource(ResourceType::StagingBuffer, ResourceOwner(), staging.size);
+	return staging;
+}
+
+void mtopengl::StreamingBuffer::returnSpare(StagingBuffer staging) {
+	if (spareBuffers.size() >= MAX_SPARE_BUFFERS || buffer == 0) {
+		deleteStaging(staging);
+		return;
+	}
+	spareBuffers.push_back(staging);
+}
+
+void mtopengl::StreamingBuffer::deleteStaging(StagingBuffer staging) {
+	glDeleteBuffers(1, &staging.buffer);
+	mtopengl::removeResource(ResourceType::StagingBuffer, ResourceOwner(), staging.size);
+}
+
+void mtopengl::StreamingBuffer::fence() {
+	if (!persistent || unfenced == 0)
+		return;
+
+	Region region;
+	region.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region.size = unfenced;
+	regions.push_back(region);
+	inFlight += unfenced;
+	unfenced = 0;
+}
+
+void mtopengl::StreamingBuffer::cleanup() {
+	for (auto& r : regions) {
+		glDeleteSync(r.sync);
+	}
+	regions.clear();
+
+	for (auto& s : spareBuffers) {
+		deleteStaging(s);
+	}
+	spareBuffers.clear();
+
+	if (buffer != 0) {
+		if (persistent) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+		mtopengl::removeResource(ResourceType::StagingBuffer, ResourceOwner(), capacity);
+	}
+	mapped = NULL;
+}
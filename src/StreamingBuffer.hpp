@@ -0,0 +1,110 @@
+#pragma once
+/**
+
+File: StreamingBuffer.hpp
+Description:
+
+A staging ring buffer for streaming data into other GPU buffers and textures. Data is written into the ring and copied into the
+target on the GPU, with glCopyBufferSubData for buffers or by sourcing a texture upload from the ring bound as a pixel unpack
+buffer, so the driver never has to stall on something the GPU may still be reading from.
+
+With ARB_buffer_storage the ring is persistently mapped and fenced per frame, writing only ever waits on a region the GPU hasn't
+finished copying out of yet. Without it the ring is orphaned each time it wraps and written through unsynchronised mappings.
+
+Uploads too big for the ring go through a staging buffer of their own, taken from a small pool. Given a completion queue, the
+buffer goes back in the pool once the GPU has finished copying out of it.
+
+OpenGL thread ONLY
+
+*/
+
+#include <GL/glew.h>
+
+#include <SFML/OpenGL.hpp>
+
+#include <deque>
+#include <cstring>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+#include "ResourceInventory.hpp"
+#include "CompletionQueue.hpp"
+
+namespace darksun::mtopengl {
+
+	class StreamingBuffer {
+
+	public:
+		StreamingBuffer() {}
+
+		// Creates the ring. Called with a current context. Without a completion queue, uploads too big for the ring go straight to
+		// their target with glBufferSubData
+		void init(GLsizeiptr size, CompletionQueue* completions = NULL);
+
+		// Copies size bytes of data into the target buffer at offset through the ring. Uploads larger than half the ring go
+		// through a pooled staging buffer instead
+		void upload(GLuint target, GLintptr offset, const void* data, GLsizeiptr size);
+
+		// Copies size bytes of data into the ring and returns their offset in it, for the caller to source from with the ring
+		// bound (as a pixel unpack buffer, say). Returns -1 if it is too big to stage, anything over half the ring
+		GLsizeiptr stage(const void* data, GLsizeiptr size);
+
+		// Fences everything written since the last call, call once per batch of uploads
+		void fence();
+
+		// Deletes the ring, any outstanding fences and the pooled staging buffers. Finish the completion queue first
+		void cleanup();
+
+		bool isInitialised() { return buffer != 0; }
+		bool isPersistent() { return persistent; }
+		GLuint getBuffer() { return buffer; }
+		GLsizeiptr getCapacity() { return capacity; }
+
+	private:
+		// Copies are kept aligned to this many bytes
+		const static GLsizeiptr ALIGNMENT = 64;
+		// Pooled staging buffers are rounded up to this, so similar sizes reuse each other
+		const static GLsizeiptr SPARE_GRANULARITY = 1024 * 1024;
+		// Staging buffers kept for reuse, any more are deleted when the GPU is done with them
+		const static size_t MAX_SPARE_BUFFERS = 4;
+
+		struct StagingBuffer {
+			GLuint buffer = 0;
+			GLsizeiptr size = 0;
+		};
+
+		struct Region {
+			GLsync sync;
+			GLsizeiptr size; // Bytes of the ring it covers, including any skipped at the end when wrapping
+		};
+
+		GLuint buffer = 0;
+		GLsizeiptr capacity = 0;
+		bool persistent = false;
+		unsigned char* mapped = NULL; // Persistent mapping
+
+		// Next write position, and where the oldest region still in use by the GPU starts
+		GLsizeiptr head = 0;
+		GLsizeiptr tail = 0;
+		// Bytes written since the last fence, and bytes covered by fences still outstanding
+		GLsizeiptr unfenced = 0;
+		GLsizeiptr inFlight = 0;
+		std::deque<Region> regions;
+
+		CompletionQueue* completions = NULL;
+		std::vector<StagingBuffer> spareBuffers;
+
+		// Takes the smallest spare buffer that fits, or creates one
+		StagingBuffer takeSpare(GLsizeiptr size);
+		// Puts a buffer the GPU has finished with back in the pool, or deletes it if the pool is full
+		void returnSpare(StagingBuffer staging);
+		void deleteStaging(StagingBuffer staging);
+
+		// Finds room for size bytes, waiting on the GPU if the ring is full. Returns the offset in the ring
+		GLsizeiptr allocate(GLsizeiptr size);
+
+		// Waits for the oldest fenced region and frees it
+		void retireOldest();
+	};
+
+}
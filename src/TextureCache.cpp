@@ -0,0 +1,415 @@
+/**
+
+File: TextureCache.cpp
+Description:
+
+Cache of preprocessed textures with their whole mip chains
+
+*/
+
+#include "TextureCache.hpp"
+
+#include "stb_image.hpp"
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#elif defined(__linux__) || defined(__APPLE__)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+using namespace darksun;
+
+static const string CACHE_DIRECTORY = "cache/textures";
+static const char CACHE_MAGIC[4] = { 'D', 'S', 'T', 'X' };
+// Bump when the layout changes, older entries are then rebuilt
+static const uint32_t CACHE_VERSION = 1;
+// Level data starts on this boundary in the file, so the mapped levels are as aligned as the upload ring
+static const size_t DATA_ALIGNMENT = 64;
+
+struct FileHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t levelCount;
+};
+
+struct FileLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset; // From the start of the level data
+	uint64_t size;
+};
+
+static size_t getDataStart(uint32_t levelCount) {
+	size_t tables = sizeof(FileHeader) + sizeof(FileLevel) * levelCount;
+	return ((tables + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT) * DATA_ALIGNMENT;
+}
+
+// The cache entry is named by the path, so both path spellings of the same file share it
+static string getCachePath(const string& path) {
+	string normal = std::filesystem::path(path).lexically_normal().generic_string();
+	uint64_t hash = texcache::hashBytes(normal.data(), normal.size());
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.dstex", (unsigned long long)hash);
+	return CACHE_DIRECTORY + "/" + name;
+}
+
+/**
+
+Mapped files
+
+*/
+
+texcache::MappedFile::~MappedFile() {
+	close();
+}
+
+#if defined(_WIN32)
+
+bool texcache::MappedFile::open(const string& path) {
+	close();
+	HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (f == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(f);
+		return false;
+	}
+	HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m == NULL) {
+		CloseHandle(f);
+		return false;
+	}
+	view = (const unsigned char*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) {
+		CloseHandle(m);
+		CloseHandle(f);
+		return false;
+	}
+	file = f;
+	mapping = m;
+	length = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void texcache::MappedFile::close() {
+	if (view != NULL)
+		UnmapViewOfFile(view);
+	if (mapping != NULL)
+		CloseHandle((HANDLE)mapping);
+	if (file != NULL)
+		CloseHandle((HANDLE)file);
+	view = NULL;
+	mapping = NULL;
+	file = NULL;
+	length = 0;
+}
+
+#elif defined(__linux__) || defined(__APPLE__)
+
+bool texcache::MappedFile::open(const string& path) {
+	close();
+	int f = ::open(path.c_str(), O_RDONLY);
+	if (f < 0)
+		return false;
+	struct stat st;
+	if (fstat(f, &st) != 0 || st.st_size == 0) {
+		::close(f);
+		return false;
+	}
+	void* v = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+	if (v == MAP_FAILED) {
+		::close(f);
+		return false;
+	}
+	fd = f;
+	view = (const unsigned char*)v;
+	length = (size_t)st.st_size;
+	return true;
+}
+
+void texcache::MappedFile::close() {
+	if (view != NULL)
+		munmap((void*)view, length);
+	if (fd >= 0)
+		::close(fd);
+	view = NULL;
+	fd = -1;
+	length = 0;
+}
+
+#else
+
+// No mapping, read it in instead
+bool texcache::MappedFile::open(const string& path) {
+	close();
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if (!in.is_open())
+		return false;
+	std::streamsize size = in.tellg();
+	if (size <= 0)
+		return false;
+	in.seekg(0, std::ios::beg);
+	fallback.resize((size_t)size);
+	if (!in.read((char*)fallback.data(), size)) {
+		fallback.clear();
+		return false;
+	}
+	view = fallback.data();
+	length = fallback.size();
+	return true;
+}
+
+void texcache::MappedFile::close() {
+	fallback.clear();
+	fallback.shrink_to_fit();
+	view = NULL;
+	length = 0;
+}
+
+#endif
+
+/**
+
+Mip chains
+
+*/
+
+// Halves src into dst with a 2x2 box filter, the last row or column is repeated when a side is odd
+static void downsample(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight, int channels) {
+	for (int y = 0; y < dstHeight; y++) {
+		const unsigned char* row0 = src + (size_t)std::min(y * 2, srcHeight - 1) * srcWidth * channels;
+		const unsigned char* row1 = src + (size_t)std::min(y * 2 + 1, srcHeight - 1) * srcWidth * channels;
+		unsigned char* out = dst + (size_t)y * dstWidth * channels;
+		for (int x = 0; x < dstWidth; x++) {
+			int x0 = std::min(x * 2, srcWidth - 1) * channels;
+			int x1 = std::min(x * 2 + 1, srcWidth - 1) * channels;
+			for (int c = 0; c < channels; c++) {
+				int sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+				out[x * channels + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+std::shared_ptr<texcache::TextureData> texcache::build(const unsigned char* pixels, int width, int height, int channels) {
+	profiler::ScopeProfiler profiler("TextureCache.cpp::texcache::build()");
+
+	std::shared_ptr<TextureData> texture = std::make_shared<TextureData>();
+	texture->width = width;
+	texture->height = height;
+	texture->channels = channels;
+
+	// Same chain as glGenerateMipmap, down to 1x1
+	size_t total = 0;
+	int w = width, h = height;
+	while (true) {
+		MipLevel level;
+		level.width = w;
+		level.height = h;
+		level.offset = total;
+		level.size = (size_t)w * h * channels;
+		texture->levels.push_back(level);
+		total += level.size;
+		if (w == 1 && h == 1)
+			break;
+		w = std::max(w / 2, 1);
+		h = std::max(h / 2, 1);
+	}
+
+	texture->memory.resize(total);
+	std::memcpy(texture->memory.data(), pixels, texture->levels[0].size);
+	for (size_t i = 1; i < texture->levels.size(); i++) {
+		const MipLevel& src = texture->levels[i - 1];
+		const MipLevel& dst = texture->levels[i];
+		downsample(texture->memory.data() + src.offset, src.width, src.height, texture->memory.data() + dst.offset, dst.width, dst.height, channels);
+	}
+	return texture;
+}
+
+/**
+
+Cache files
+
+*/
+
+uint64_t texcache::hashBytes(const void* data, size_t size, uint64_t hash) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::shared_ptr<texcache::TextureData> texcache::load(const string& path, uint64_t sourceHash) {
+	profiler::ScopeProfiler profiler("TextureCache.cpp::texcache::load()");
+
+	std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>();
+	if (!file->open(getCachePath(path)))
+		return NULL; // Not built yet
+
+	if (file->size() < sizeof(FileHeader))
+		return NULL;
+	FileHeader header;
+	std::memcpy(&header, file->data(), sizeof(FileHeader));
+	if (std::memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION || header.sourceHash != sourceHash)
+		return NULL; // Stale, the source or the format has changed since it was built
+	if (header.levelCount == 0 || header.levelCount > 32 || header.channels == 0 || header.channels > 4)
+		return NULL;
+
+	size_t dataStart = getDataStart(header.levelCount);
+	if (file->size() < dataStart)
+		return NULL;
+
+	std::shared_ptr<TextureData> texture = std::make_shared<TextureData>();
+	texture->width = (int)header.width;
+	texture->height = (int)header.height;
+	texture->channels = (int)header.channels;
+	for (uint32_t i = 0; i < header.levelCount; i++) {
+		FileLevel fileLevel;
+		std::memcpy(&fileLevel, file->data() + sizeof(FileHeader) + sizeof(FileLevel) * i, sizeof(FileLevel));
+		if (fileLevel.size != (uint64_t)fileLevel.width * fileLevel.height * header.channels ||
+			dataStart + fileLevel.offset + fileLevel.size > file->size()) {
+			dout.warn("TextureCache --> Cache entry for '" + path + "' is damaged, rebuilding it");
+			return NULL;
+		}
+		MipLevel level;
+		level.width = (int)fileLevel.width;
+		level.height = (int)fileLevel.height;
+		level.offset = (size_t)fileLevel.offset;
+		level.size = (size_t)fileLevel.size;
+		texture->levels.push_back(level);
+	}
+
+	texture->mapped = std::move(file);
+	texture->mappedOffset = dataStart;
+	return texture;
+}
+
+bool texcache::store(const string& path, uint64_t sourceHash, const TextureData& texture) {
+	profiler::ScopeProfiler profiler("TextureCache.cpp::texcache::store()");
+
+	string cachePath = getCachePath(path);
+	string tempPath = cachePath + ".tmp";
+
+	std::error_code error;
+	std::filesystem::create_directories(CACHE_DIRECTORY, error);
+
+	FileHeader header;
+	std::memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.width = (uint32_t)texture.width;
+	header.height = (uint32_t)texture.height;
+	header.channels = (uint32_t)texture.channels;
+	header.levelCount = (uint32_t)texture.levels.size();
+
+	std::vector<FileLevel> fileLevels;
+	for (auto const& l : texture.levels) {
+		FileLevel fileLevel;
+		fileLevel.width = (uint32_t)l.width;
+		fileLevel.height = (uint32_t)l.height;
+		fileLevel.offset = (uint64_t)l.offset;
+		fileLevel.size = (uint64_t)l.size;
+		fileLevels.push_back(fileLevel);
+	}
+
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			dout.warn("TextureCache --> Could not write the cache entry for '" + path + "'");
+			return false;
+		}
+		size_t tables = sizeof(FileHeader) + sizeof(FileLevel) * fileLevels.size();
+		std::vector<char> padding(getDataStart(header.levelCount) - tables, 0);
+		out.write((const char*)&header, sizeof(FileHeader));
+		out.write((const char*)fileLevels.data(), sizeof(FileLevel) * fileLevels.size());
+		out.write(padding.data(), padding.size());
+		out.write((const char*)texture.pixels(), texture.getTotalSize());
+		if (!out.good()) {
+			out.close();
+			std::filesystem::remove(tempPath, error);
+			dout.warn("TextureCache --> Could not write the cache entry for '" + path + "'");
+			return false;
+		}
+	}
+
+	// Written in full before it replaces the old entry, so a crash part way through never leaves a broken one behind
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error) {
+		std::filesystem::remove(tempPath, error);
+		dout.warn("TextureCache --> Could not replace the cache entry for '" + path + "'");
+		return false;
+	}
+	dout.verbose("TextureCache --> Cached '" + path + "' as '" + cachePath + "'");
+	return true;
+}
+
+int texcache::convertDirectory(const string& directory) {
+	profiler::ScopeProfiler profiler("TextureCache.cpp::texcache::convertDirectory()");
+
+	std::error_code error;
+	if (!std::filesystem::is_directory(directory, error)) {
+		dout.error("TextureCache --> '" + directory + "' is not a directory");
+		return 0;
+	}
+
+	std::vector<string> images;
+	for (auto const& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+		if (!entry.is_regular_file())
+			continue;
+		string extension = entry.path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" || extension == ".bmp") {
+			images.push_back(entry.path().generic_string());
+		}
+	}
+
+	dout.log("TextureCache --> Checking " + std::to_string(images.size()) + " images under '" + directory + "'");
+
+	std::atomic<int> built = 0;
+	jobs::parallelFor("texcache::convert", 0, (int)images.size(), 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			const string& path = images[i];
+			std::ifstream in(path, std::ios::binary | std::ios::ate);
+			if (!in.is_open())
+				continue;
+			std::vector<char> bytes((size_t)in.tellg());
+			in.seekg(0, std::ios::beg);
+			if (!in.read(bytes.data(), bytes.size()))
+				continue;
+
+			uint64_t sourceHash = hashBytes(bytes.data(), bytes.size());
+			if (load(path, sourceHash) != NULL)
+				continue; // Up to date
+
+			int width, height, nrComponents;
+			unsigned char* data = stbi_load_from_memory((const stbi_uc*)bytes.data(), (int)bytes.size(), &width, &height, &nrComponents, 0);
+			if (data == NULL) {
+				dout.warn("TextureCache --> Could not decode '" + path + "', skipping it");
+				continue;
+			}
+			std::shared_ptr<TextureData> texture = build(data, width, height, nrComponents);
+			stbi_image_free(data);
+			if (store(path, sourceHash, *texture))
+				built++;
+		}
+	});
+
+	dout.log("TextureCache --> Built " + std::to_string(built.load()) + " cache entries for '" + directory + "'");
+	return built.load();
+}
+
+string texcache::getCacheDirectory() {
+	return CACHE_DIRECTORY;
+}
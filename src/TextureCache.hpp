@@ -0,0 +1,108 @@
+#pragma once
+/**
+
+File: TextureCache.hpp
+Description:
+
+Cache of preprocessed textures. The first time an image is loaded it is decoded and its whole mip chain is built on the CPU and
+written to the cache in the layout the OpenGL thread uploads it in, later loads memory map the cache file and hand the levels
+straight to the upload without decoding anything or generating mipmaps on the GPU.
+
+Entries are named by the hash of the source path and store the FNV-1a hash of the source file's bytes, an entry built from
+different bytes is stale and is rebuilt the next time the image is loaded.
+
+THREADING IN OPERATION, thread safe. Requests for the same path must not run at the same time, mtopengl::requestTexture makes
+sure of that
+
+*/
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+#include "JobSystem.hpp"
+
+using string = std::string;
+
+namespace darksun::texcache {
+
+	// A read only view of a whole file, mapped into memory where the platform allows and read in otherwise
+	class MappedFile {
+
+	public:
+		MappedFile() {}
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Returns false if the file couldn't be opened or is empty
+		bool open(const string& path);
+		void close();
+
+		const unsigned char* data() const { return view; }
+		size_t size() const { return length; }
+
+	private:
+		const unsigned char* view = NULL;
+		size_t length = 0;
+
+		// Platform handles
+		void* file = NULL;
+		void* mapping = NULL;
+		int fd = -1;
+		std::vector<unsigned char> fallback; // Used where there is no mapping
+	};
+
+	struct MipLevel {
+		int width = 0;
+		int height = 0;
+		size_t offset = 0;	// From pixels()
+		size_t size = 0;
+	};
+
+	// A texture with its whole mip chain, level 0 first. Rows are tightly packed with channels bytes per pixel
+	struct TextureData {
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		std::vector<MipLevel> levels;
+
+		// Where the levels live, built in memory or mapped from the cache
+		std::vector<unsigned char> memory;
+		std::unique_ptr<MappedFile> mapped;
+		size_t mappedOffset = 0;
+
+		const unsigned char* pixels() const { return mapped != NULL ? mapped->data() + mappedOffset : memory.data(); }
+		const unsigned char* getLevel(int level) const { return pixels() + levels[level].offset; }
+		size_t getTotalSize() const { return levels.empty() ? 0 : levels.back().offset + levels.back().size; }
+	};
+
+	// FNV-1a over the bytes, carries on from hash
+	uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+	// Returns the cached texture for path if its entry was built from a source with this hash, NULL if it is missing or stale
+	std::shared_ptr<TextureData> load(const string& path, uint64_t sourceHash);
+
+	// Builds the whole mip chain from decoded level 0 pixels with a 2x2 box filter
+	std::shared_ptr<TextureData> build(const unsigned char* pixels, int width, int height, int channels);
+
+	// Writes the cache entry for path, replacing any stale one. Returns false if it couldn't be written, which only costs the next
+	// load a decode
+	bool store(const string& path, uint64_t sourceHash, const TextureData& texture);
+
+	// Offline converter, brings the cache entry of every image under directory up to date across the workers. Returns the number of
+	// entries (re)built
+	int convertDirectory(const string& directory);
+
+	// Where the cache files are kept, relative to the working directory
+	string getCacheDirectory();
+
+}
@@ -0,0 +1,198 @@
+/**
+
+File: ThreadConfig.cpp
+Description:
+
+Names, pins and prioritises the engine threads
+
+*/
+
+#include "ThreadConfig.hpp"
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+	#include <unistd.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+#endif
+
+using namespace darksun;
+
+static std::mutex roleSettings_mutex = std::mutex();
+static threads::ThreadSettings roleSettings[(int)threads::ThreadRole::COUNT] = {
+	threads::getDefaultSettings(threads::ThreadRole::Main),
+	threads::getDefaultSettings(threads::ThreadRole::Render),
+	threads::getDefaultSettings(threads::ThreadRole::Worker)
+};
+
+static thread_local string currentThreadName = "";
+
+/**
+
+Platform specific
+
+*/
+
+#if defined(_WIN32)
+
+static bool setName(string name) {
+	std::wstring wide = std::wstring(name.begin(), name.end());
+	return SUCCEEDED(SetThreadDescription(GetCurrentThread(), wide.c_str()));
+}
+
+static bool setAffinity(const std::vector<int>& cores) {
+	DWORD_PTR mask = 0;
+	for (int c : cores) {
+		mask |= ((DWORD_PTR)1) << c;
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
+static bool setPriority(threads::ThreadPriority priority) {
+	int p = THREAD_PRIORITY_NORMAL;
+	switch (priority) {
+	case threads::ThreadPriority::Low: p = THREAD_PRIORITY_BELOW_NORMAL; break;
+	case threads::ThreadPriority::Normal: p = THREAD_PRIORITY_NORMAL; break;
+	case threads::ThreadPriority::High: p = THREAD_PRIORITY_ABOVE_NORMAL; break;
+	case threads::ThreadPriority::Critical: p = THREAD_PRIORITY_HIGHEST; break;
+	}
+	return SetThreadPriority(GetCurrentThread(), p) != 0;
+}
+
+#elif defined(__linux__)
+
+static bool setName(string name) {
+	// Linux only keeps 15 characters
+	if (name.size() > 15)
+		name = name.substr(0, 15);
+	return pthread_setname_np(pthread_self(), name.c_str()) == 0;
+}
+
+static bool setAffinity(const std::vector<int>& cores) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int c : cores) {
+		CPU_SET(c, &set);
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+static bool setPriority(threads::ThreadPriority priority) {
+	// Nice values are per thread on Linux. Going below 0 needs CAP_SYS_NICE
+	int nice = 0;
+	switch (priority) {
+	case threads::ThreadPriority::Low: nice = 10; break;
+	case threads::ThreadPriority::Normal: nice = 0; break;
+	case threads::ThreadPriority::High: nice = -5; break;
+	case threads::ThreadPriority::Critical: nice = -10; break;
+	}
+	return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice) == 0;
+}
+
+#else
+
+static bool setName(string name) { return false; }
+static bool setAffinity(const std::vector<int>& cores) { return false; }
+static bool setPriority(threads::ThreadPriority priority) { return false; }
+
+#endif
+
+/**
+
+Public interface
+
+*/
+
+threads::ThreadSettings threads::getDefaultSettings(ThreadRole role) {
+	ThreadSettings settings;
+	switch (role) {
+	case ThreadRole::Main: settings.name = "DS Main"; break;
+	case ThreadRole::Render: settings.name = "DS Render"; break;
+	case ThreadRole::Worker: settings.name = "DS Worker"; break;
+	default: break;
+	}
+	return settings;
+}
+
+void threads::setRoleSettings(ThreadRole role, ThreadSettings settings) {
+	std::lock_guard lock(roleSettings_mutex);
+	roleSettings[(int)role] = settings;
+}
+
+void threads::applyRole(ThreadRole role, int index) {
+	ThreadSettings settings;
+	{
+		std::lock_guard lock(roleSettings_mutex);
+		settings = roleSettings[(int)role];
+	}
+
+	string name = settings.name;
+	std::vector<int> cores = settings.cores;
+	if (role == ThreadRole::Worker && index >= 0) {
+		name += " " + std::to_string(index);
+		// Spread the workers over the cores, one core each
+		if (!cores.empty())
+			cores = { cores[index % cores.size()] };
+	}
+
+	if (!name.empty()) {
+		currentThreadName = name;
+		profiler::setThreadName(name);
+		if (!setName(name))
+			dout.warn("ThreadConfig --> Failed to set the OS name of thread '" + name + "'");
+	}
+
+	if (!cores.empty()) {
+		if (setAffinity(cores)) {
+			string list = "";
+			for (int c : cores) {
+				list += (list.empty() ? "" : ",") + std::to_string(c);
+			}
+			dout.verbose("ThreadConfig --> '" + name + "' pinned to cores " + list);
+		}
+		else {
+			dout.warn("ThreadConfig --> Failed to pin '" + name + "' to its cores");
+		}
+	}
+
+	if (settings.priority != ThreadPriority::Normal && !setPriority(settings.priority)) {
+		dout.warn("ThreadConfig --> Failed to set the priority of '" + name + "', the process may not be allowed to raise it");
+	}
+}
+
+string threads::getCurrentThreadName() {
+	return currentThreadName;
+}
+
+bool threads::priorityFromString(string s, ThreadPriority& priority) {
+	if (s.compare("low") == 0) {
+		priority = ThreadPriority::Low;
+	}
+	else if (s.compare("normal") == 0) {
+		priority = ThreadPriority::Normal;
+	}
+	else if (s.compare("high") == 0) {
+		priority = ThreadPriority::High;
+	}
+	else if (s.compare("critical") == 0) {
+		priority = ThreadPriority::Critical;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+string threads::roleToString(ThreadRole role) {
+	switch (role) {
+	case ThreadRole::Main: return "main";
+	case ThreadRole::Render: return "render";
+	case ThreadRole::Worker: return "workers";
+	default: return "unknown";
+	}
+}
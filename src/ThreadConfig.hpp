@@ -0,0 +1,66 @@
+#pragma once
+/**
+
+File: ThreadConfig.hpp
+Description:
+
+Names, pins and prioritises the engine threads. Each engine thread role (main, render, workers) has its settings loaded from
+'settings.lua', and every thread applies the settings of its role to itself when it starts. The names are passed to the OS, so
+they show up in debuggers and tools like perf, and to the profiler, so profiled scopes can be matched up with those tools.
+
+Settings are set once at startup before any thread applies them, applying is thread safe
+
+*/
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+
+#include "Log.hpp"
+#include "DarkSunProfiler.hpp"
+
+using string = std::string;
+
+namespace darksun::threads {
+
+	enum class ThreadRole {
+		Main = 0,
+		Render,
+		Worker,
+		COUNT
+	};
+
+	enum class ThreadPriority {
+		Low = 0,
+		Normal,
+		High,
+		Critical
+	};
+
+	struct ThreadSettings {
+		// Shown by the OS and prefixed to the profiler references. Workers get their index appended
+		string name = "";
+		// Cores the thread may run on, empty for no pinning. Workers are each pinned to one of these in turn
+		std::vector<int> cores;
+		ThreadPriority priority = ThreadPriority::Normal;
+	};
+
+	// Returns the settings a role uses when nothing has been configured
+	ThreadSettings getDefaultSettings(ThreadRole role);
+
+	// Sets the settings for a role. Call before the threads of that role are started
+	void setRoleSettings(ThreadRole role, ThreadSettings settings);
+
+	// Applies the settings of the role to the calling thread. index is the worker index, and is ignored for other roles
+	void applyRole(ThreadRole role, int index = -1);
+
+	// Returns the name given to the calling thread, or an empty string if it hasn't been given one
+	string getCurrentThreadName();
+
+	// Converts "low", "normal", "high" or "critical" into a priority. Returns false if the string isn't one of those
+	bool priorityFromString(string s, ThreadPriority& priority);
+
+	string roleToString(ThreadRole role);
+
+}
@@ -19,7 +19,11 @@ UIWrangler::UIWrangler(sf::RenderWindow* windowHandle, std::shared_ptr<Camera> c
 
 	{
 		std::lock_guard lock(gui_mutex);
-		gui = std::unique_ptr<tgui::Gui>(new tgui::Gui(*windowHandle));
+		// No window when headless, the gui and its scripts still run but are never drawn
+		if (windowHandle != NULL)
+			gui = std::unique_ptr<tgui::Gui>(new tgui::Gui(*windowHandle));
+		else
+			gui = std::unique_ptr<tgui::Gui>(new tgui::Gui());
 	}
 
 	hookUIInterface(settings);
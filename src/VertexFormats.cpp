@@ -0,0 +1,113 @@
+/**
+
+File: VertexFormats.cpp
+Description:
+
+The layouts mesh vertices and indices can take on the GPU
+
+*/
+
+#include "VertexFormats.hpp"
+
+using namespace darksun;
+
+size_t mtopengl::getVertexSize(VertexFormat format) {
+	switch (format) {
+	case VertexFormat::Standard: return sizeof(StandardVertex);
+	case VertexFormat::Terrain: return sizeof(TerrainVertex);
+	default: return sizeof(Vertex);
+	}
+}
+
+void mtopengl::packVertices(VertexFormat format, const Vertex* vertices, unsigned int count, unsigned char* out) {
+	switch (format) {
+	case VertexFormat::Standard: {
+		StandardVertex* packed = reinterpret_cast<StandardVertex*>(out);
+		for (unsigned int i = 0; i < count; i++) {
+			packed[i].Position = vertices[i].Position;
+			packed[i].Normal = glm::packSnorm3x10_1x2(glm::vec4(vertices[i].Normal, 0.0f));
+			packed[i].TexCoords = vertices[i].TexCoords;
+		}
+		break;
+	}
+	case VertexFormat::Terrain: {
+		TerrainVertex* packed = reinterpret_cast<TerrainVertex*>(out);
+		for (unsigned int i = 0; i < count; i++) {
+			packed[i].Position = vertices[i].Position;
+			packed[i].Normal = glm::packSnorm3x10_1x2(glm::vec4(vertices[i].Normal, 0.0f));
+			packed[i].TexCoords = glm::packHalf2x16(vertices[i].TexCoords);
+		}
+		break;
+	}
+	default:
+		std::memcpy(out, vertices, (size_t)count * sizeof(Vertex));
+		break;
+	}
+}
+
+void mtopengl::setupVertexFormat(VertexFormat format) {
+	switch (format) {
+	case VertexFormat::Standard:
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(StandardVertex), (void*)offsetof(StandardVertex, Position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(StandardVertex), (void*)offsetof(StandardVertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(StandardVertex), (void*)offsetof(StandardVertex, TexCoords));
+		break;
+	case VertexFormat::Terrain:
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, Position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, TexCoords));
+		break;
+	default:
+		// vertex positions
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		// vertex normals
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		// vertex texture coords
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		// vertex tangent
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+		// vertex bitangent
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		break;
+	}
+}
+
+string mtopengl::vertexFormatToString(VertexFormat format) {
+	switch (format) {
+	case VertexFormat::Full: return "full";
+	case VertexFormat::Standard: return "standard";
+	case VertexFormat::Terrain: return "terrain";
+	default: return "unknown";
+	}
+}
+
+GLenum mtopengl::chooseIndexType(size_t numVertices) {
+	return (numVertices <= 65536) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+size_t mtopengl::getIndexSize(GLenum indexType) {
+	return (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+void mtopengl::packIndices(GLenum indexType, const unsigned int* indices, unsigned int count, unsigned char* out) {
+	if (indexType == GL_UNSIGNED_SHORT) {
+		uint16_t* packed = reinterpret_cast<uint16_t*>(out);
+		for (unsigned int i = 0; i < count; i++) {
+			packed[i] = (uint16_t)indices[i];
+		}
+	}
+	else {
+		std::memcpy(out, indices, (size_t)count * sizeof(uint32_t));
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+/**
+
+File: VertexFormats.hpp
+Description:
+
+The layouts mesh vertices and indices can take on the GPU. Meshes build full Vertex data on the CPU and it is packed into the layout
+chosen for the mesh as it goes into the command stream. Attribute locations stay the same in every layout (0 position,
+1 normal, 2 texture coordinates, 3 tangent, 4 bitangent) and packed attributes are unpacked by the vertex fetch, so every
+shader works with every layout.
+
+ Full		56 bytes	float position, normal, texture coordinates, tangent and bitangent
+ Standard	24 bytes	float position and texture coordinates, normal as GL_INT_2_10_10_10_REV
+ Terrain	20 bytes	float position, normal as GL_INT_2_10_10_10_REV, texture coordinates as half floats
+
+Indices are 16 bit for any mesh with few enough vertices, 32 bit otherwise. Indices are relative to the mesh's base vertex,
+so this only depends on the size of the mesh.
+
+*/
+
+#include <GL/glew.h>
+
+#include <SFML/OpenGL.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#include "OpenGLStructs.hpp"
+
+namespace darksun::mtopengl {
+
+	struct StandardVertex {
+		glm::vec3 Position;
+		uint32_t Normal;	// Signed normalised 10:10:10:2, w unused
+		glm::vec2 TexCoords;
+	};
+
+	struct TerrainVertex {
+		glm::vec3 Position;
+		uint32_t Normal;	// Signed normalised 10:10:10:2, w unused
+		uint32_t TexCoords;	// Two half floats
+	};
+
+	// Bytes one vertex takes in the layout
+	size_t getVertexSize(VertexFormat format);
+
+	// Packs count vertices into the layout, out must have room for count * getVertexSize(format) bytes
+	void packVertices(VertexFormat format, const Vertex* vertices, unsigned int count, unsigned char* out);
+
+	// Points the attributes of the bound VAO at the layout in the bound GL_ARRAY_BUFFER. OpenGL thread ONLY
+	void setupVertexFormat(VertexFormat format);
+
+	string vertexFormatToString(VertexFormat format);
+
+	// GL_UNSIGNED_SHORT if every index of a mesh with this many vertices fits in 16 bits, GL_UNSIGNED_INT otherwise
+	GLenum chooseIndexType(size_t numVertices);
+
+	// Bytes one index of the type takes
+	size_t getIndexSize(GLenum indexType);
+
+	// Packs count indices into the type, out must have room for count * getIndexSize(indexType) bytes
+	void packIndices(GLenum indexType, const unsigned int* indices, unsigned int count, unsigned char* out);
+
+}